@@ -69,6 +69,9 @@ set(common_source
     mode/field.cpp
     mode/field.hpp
     mode/fieldimpl.hpp
+    mode/jobqueue.hpp
+    mode/privatefield.hpp
+    mode/raycache.hpp
     mode/modemodule.hpp
     mode/ray.cpp
     mode/ray.hpp
@@ -100,7 +103,9 @@ set(common_source
     util/errors.cpp
     util/errors.hpp
     util/ldio.hpp
+    util/mappedfile.hpp
     util/prtfileemu.hpp
+    util/threadpool.hpp
     util/timing.cpp
     util/timing.hpp
     util/unformattedio.hpp
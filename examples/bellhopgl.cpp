@@ -1428,9 +1428,7 @@ int main(int argc, char **argv)
     // We are updating the speed of sound paramters
     if (params.ssp->NPts != sosVectorX.size())
     {
-      params.ssp->NPts = sosVectorX.size();
-      params.ssp->Nz = params.ssp->NPts;
-      // memory does not need to be mangaged for this one, it has been statically allocated at the beginning
+      bhc::extsetup_ssp<false>(params, sosVectorX.size());
       for (int i = 0; i < params.ssp->NPts; ++i)
       {
         params.ssp->z[i] = sosVectorX[i];
@@ -230,6 +230,23 @@ extern template BHC_API void extsetup_trc<true>(bhcParams<true> &params, int32_t
 template<bool O3D> void extsetup_brc(bhcParams<O3D> &params, int32_t NPts);
 extern template BHC_API void extsetup_brc<false>(bhcParams<false> &params, int32_t NPts);
 extern template BHC_API void extsetup_brc<true>(bhcParams<true> &params, int32_t NPts);
+/**
+ * Reallocate the SSP profile (params.ssp->z, .alphaR, .betaR, .rho, .alphaI,
+ * and .betaI) to NPts points, keeping the values of the existing points, and
+ * set params.ssp->NPts. This is for the SSP modes other than quad or
+ * hexahedral; see extsetup_ssp_quad() for how to set up the rest.
+ *
+ * Breaking change: the profile arrays used to be fixed arrays of MaxSSP points,
+ * and are now allocated to the size of the SSP read from the env file (2 points
+ * without an env file), or the last size passed here. Code which increases
+ * params.ssp->NPts and writes the new points directly must call extsetup_ssp()
+ * first, or it will write past the end of the arrays. run() and validate()
+ * report NPts larger than the arrays, but only after the memory has already
+ * been overwritten.
+ */
+template<bool O3D> void extsetup_ssp(bhcParams<O3D> &params, int32_t NPts);
+extern template BHC_API void extsetup_ssp<false>(bhcParams<false> &params, int32_t NPts);
+extern template BHC_API void extsetup_ssp<true>(bhcParams<true> &params, int32_t NPts);
 /**
  * Set up and/or reallocate the SSP for quad mode (2D only). NPts is the number
  * of depths. Fill in params.ssp->z, params.ssp->Seg.r, and params.ssp->cMat[z *
@@ -244,11 +261,10 @@ extern template BHC_API void extsetup_brc<true>(bhcParams<true> &params, int32_t
  * (not immediately after calling this function), you'll need to set the dirty
  * flag each time it is changed.
  *
- * To set the SSP to a mode other than quad or hexahedral, an extsetup call is
- * not needed. Just
+ * To set the SSP to a mode other than quad or hexahedral:
  * - set params.ssp->Type to the correct letter
- * - set params.ssp->NPts and fill in params->ssp.z[:], .alphaR, .betaR, .rho,
- *   .alphaI, and .betaI
+ * - if the number of points changes, call extsetup_ssp()
+ * - fill in params->ssp.z[:], .alphaR, .betaR, .rho, .alphaI, and .betaI
  * - make sure the surface and bottom depths are set correctly as described
  *   above
  * - set the dirty flag
@@ -270,8 +286,8 @@ extern BHC_API void extsetup_ssp_quad(bhcParams<false> &params, int32_t NPts, in
  * (not immediately after calling this function), you'll need to set the dirty
  * flag each time it is changed.
  *
- * To set the SSP to a mode other than quad or hexahedral, an extsetup call is
- * not needed; see the doc for extsetup_ssp_quad() for more info.
+ * To set the SSP to a mode other than quad or hexahedral, see the doc for
+ * extsetup_ssp_quad().
  */
 extern BHC_API void extsetup_ssp_hexahedral(
     bhcParams<true> &params, int32_t Nx, int32_t Ny, int32_t Nz);
@@ -309,6 +325,96 @@ extern template BHC_API bool run<true, false>(
 extern template BHC_API bool run<true, true>(
     bhcParams<true> &params, bhcOutputs<true, true> &outputs);
 
+/**
+ * Same as run(), but the run happens in a background thread and this returns
+ * immediately. params and outputs are used by reference, so they must stay
+ * alive and must not be accessed (or passed to other API calls) until
+ * run_wait() has returned. Only one run at a time is possible per instance.
+ *
+ * If you passed callbacks to setup(), they will be called from the background
+ * thread.
+ *
+ * returns: handle to pass to run_poll(), run_wait(), and run_cancel(). Its
+ * internal member is nullptr if the run could not be started.
+ */
+template<bool O3D, bool R3D> bhcRunHandle run_async(
+    bhcParams<O3D> &params, bhcOutputs<O3D, R3D> &outputs);
+
+/// 2D version, see template.
+extern template BHC_API bhcRunHandle run_async<false, false>(
+    bhcParams<false> &params, bhcOutputs<false, false> &outputs);
+/// Nx2D version, see template.
+extern template BHC_API bhcRunHandle run_async<true, false>(
+    bhcParams<true> &params, bhcOutputs<true, false> &outputs);
+/// 3D version, see template.
+extern template BHC_API bhcRunHandle run_async<true, true>(
+    bhcParams<true> &params, bhcOutputs<true, true> &outputs);
+
+/**
+ * Progress of a run started with run_async(). jobsDone and jobsTotal (either may
+ * be nullptr) receive the number of rays completed and the total number of rays
+ * in the current phase of the run. Some run types have more than one phase,
+ * e.g. eigenrays first traces all the rays and then re-traces the eigenrays.
+ * Progress is only reported by bellhopcxx; in bellhopcuda the counts stay 0.
+ *
+ * returns: true if the run has finished, i.e. run_wait() will not block.
+ */
+extern BHC_API bool run_poll(bhcRunHandle handle, int32_t *jobsDone, int32_t *jobsTotal);
+
+/**
+ * Waits for a run started with run_async() to finish. Must be called once for
+ * every successfully started run, including cancelled ones, before the instance
+ * can be used again.
+ *
+ * returns: false if an error occurred or the run was cancelled, true if no
+ * errors.
+ */
+extern BHC_API bool run_wait(bhcRunHandle handle);
+
+/**
+ * Requests cancellation of a run started with run_async(). Returns immediately;
+ * the workers stop at the next ray. The outputs of a cancelled run are
+ * incomplete. You still have to call run_wait().
+ */
+extern BHC_API void run_cancel(bhcRunHandle handle);
+
+/**
+ * Runs many instances, e.g. the scenarios of a parameter sweep, on one shared
+ * set of numThreads worker threads (-1 means "all logical cores"), instead of
+ * each run using the threads of its own instance. Each thread takes the next
+ * instance which has not been started, and the ray jobs of all the instances
+ * which are running are interleaved on the shared threads. For many small
+ * runs, set bhcInit::numThreads of each instance to 1: then each thread does
+ * one run at a time, without oversubscribing the machine. Larger values split
+ * each run into more tasks, so that the threads which run out of instances can
+ * help with the last ones, at the cost of more memory per instance.
+ * bhcInit::pinThreads does not apply to the shared threads.
+ *
+ * params and outputs are arrays of count instances, each set up with setup()
+ * and not running with run_async(). Each instance is run exactly like with
+ * run(). results (may be nullptr) is an array of count which receives the
+ * return value of each run.
+ *
+ * returns: false if any run failed or could not be started, true if all
+ * succeeded.
+ */
+template<bool O3D, bool R3D> bool run_batch(
+    bhcParams<O3D> *params, bhcOutputs<O3D, R3D> *outputs, int32_t count,
+    int32_t numThreads, bool *results);
+
+/// 2D version, see template.
+extern template BHC_API bool run_batch<false, false>(
+    bhcParams<false> *params, bhcOutputs<false, false> *outputs, int32_t count,
+    int32_t numThreads, bool *results);
+/// Nx2D version, see template.
+extern template BHC_API bool run_batch<true, false>(
+    bhcParams<true> *params, bhcOutputs<true, false> *outputs, int32_t count,
+    int32_t numThreads, bool *results);
+/// 3D version, see template.
+extern template BHC_API bool run_batch<true, true>(
+    bhcParams<true> *params, bhcOutputs<true, true> *outputs, int32_t count,
+    int32_t numThreads, bool *results);
+
 /**
  * Write results for the past run to BELLHOP-formatted files, i.e. a ray file,
  * a shade file, or an arrivals file. If you only want to use the results in
@@ -363,6 +469,53 @@ extern template BHC_API bool readout<true, false>(
 extern template BHC_API bool readout<true, true>(
     bhcParams<true> &params, bhcOutputs<true, true> &outputs, const char *FileRoot);
 
+/**
+ * Open a TL / shade file from a past run as a read-only, memory-mapped view,
+ * instead of reading the whole field into memory with readout(). As with
+ * readout(), the header of the file (source and receiver positions,
+ * frequencies) is loaded into params, which should have already been
+ * initialized with the same or a similar environment file. The field values
+ * are only read from disk as they are accessed through shd_row(), so e.g. one
+ * bearing or one depth can be extracted from a very large file without reading
+ * all of it.
+ *
+ * You can pass nullptr for FileRoot to read from the shade file relative to the
+ * same FileRoot that the environment file was originally loaded from.
+ *
+ * returns: handle to pass to shd_row() and shd_close(). Its internal member is
+ * nullptr if an error occurred.
+ */
+template<bool O3D> bhcShdView shd_open(bhcParams<O3D> &params, const char *FileRoot);
+
+/// 2D version, see template.
+extern template BHC_API bhcShdView shd_open<false>(
+    bhcParams<false> &params, const char *FileRoot);
+/// 3D or Nx2D version, see template.
+extern template BHC_API bhcShdView shd_open<true>(
+    bhcParams<true> &params, const char *FileRoot);
+
+/**
+ * Field of an SHD file opened with shd_open(), at all params.Pos->NRr receiver
+ * ranges, for source (isx, isy, isz), receiver bearing itheta, and receiver
+ * depth Irz (for irregular grids, receiver Irz). These are the same values
+ * which readout() would place in outputs.uAllSources at
+ * (((((isz * NSx + isx) * NSy + isy) * Ntheta + itheta) * NRz_per_range + Irz)
+ * * NRr). For broadband files (see bhcInit::broadbandTL), ifreq selects the
+ * frequency. The pointer is into the mapped file and is valid until
+ * shd_close().
+ *
+ * returns: nullptr if the view is not open or the indices are out of range.
+ */
+extern BHC_API const cpxf *shd_row(
+    bhcShdView view, int32_t isx, int32_t isy, int32_t itheta, int32_t isz, int32_t Irz,
+    int32_t ifreq = 0);
+
+/**
+ * Close an SHD file opened with shd_open(). Pointers returned by shd_row() for
+ * this view become invalid.
+ */
+extern BHC_API void shd_close(bhcShdView view);
+
 /**
  * Write the current params state to an environment file and any other "input"
  * file types (e.g. SSP, bathymetry, etc.), so that the state can be loaded
@@ -63,26 +63,82 @@ template<bool X3D> using V2M2 = typename TmplVec2Mat2<X3D>::type;
 // SSP / Boundary
 ////////////////////////////////////////////////////////////////////////////////
 
-constexpr int32_t MaxN   = 100000;
-constexpr int32_t MaxSSP = MaxN + 1;
+constexpr int32_t MaxN        = 100000;
+constexpr int32_t MaxSSP      = MaxN + 1;
+constexpr int32_t MaxSSPTable = 8192; // cells, see SSPTable
 
 struct rxyz_vector {
     real *r, *x, *y, *z;
 };
 
+/**
+ * Spacing of a grid of coordinates, computed in preprocess. If the grid is
+ * uniform, point i is at (about) x0 + i / invDx, and the segment containing a
+ * position is found by direct indexing. invDx is 0 if the grid is not uniform;
+ * the segment is then searched for from the previous one.
+ */
+struct UniformGrid {
+    real x0, invDx;
+};
+
+/**
+ * Coefficients of the SSP in layer iz (between z[iz] and z[iz + 1]), packed
+ * together so that evaluating the SSP in a layer touches a single cache line.
+ * Computed from the profile in preprocessing. Which ones are used depends on
+ * the SSP type:
+ * - C-linear: c[iz], cz[iz] (gradient)
+ * - N2-linear: n2[iz], n2z[iz] (gradient), n2[iz + 1]
+ * - Cubic spline: cSpline[0:4][iz]
+ * - PCHIP: cCoef[0:4][iz] (polynomial coefficients)
+ */
+struct SSPLayer {
+    cpx coef[4];
+};
+
+/**
+ * Cell of an SSPTable: the real part of c at the top of the cell and its
+ * derivatives, scaled by powers of the cell height, i.e. the cubic of layer iz
+ * in the normalized depth u in [0, 1) within the cell: c(u) = coef[0] +
+ * coef[1] u + coef[2] u^2 + coef[3] u^3. iz is -1 if an SSP point is inside
+ * the cell.
+ */
+struct SSPTableCell {
+    real coef[4];
+    int32_t iz;
+};
+
+/**
+ * Cubic spline or PCHIP SSP resampled on a uniform depth grid, see
+ * bhcInit::sspTable. Cell i covers depths z0 + [i, i + 1) / invDz. The
+ * imaginary part of c (attenuation) is not in the table.
+ */
+struct SSPTable {
+    SSPTableCell *cell; // [n], computed in preprocess; nullptr if not used
+    real z0, invDz;
+    int32_t n;
+    bool lossy; // whether the profile has attenuation
+};
+
 struct SSPStructure {
     // LP: Start with complex values for alignment reasons.
-    cpx c[MaxSSP], cz[MaxSSP], n2[MaxSSP], n2z[MaxSSP], cSpline[4][MaxSSP];
-    cpx cCoef[4][MaxSSP], CSWork[4][MaxSSP]; // for PCHIP coefs.
+    cpx *c;          // [NPts], computed in preprocess
+    SSPLayer *layer; // [NPts], computed in preprocess
     real *cMat, *czMat; // LP: No need for separate cMat3 / czMat3 as we don't have to
                         // specify the dimension here.
     rxyz_vector Seg;
-    real z[MaxSSP], rho[MaxSSP];
-    real alphaR[MaxSSP], alphaI[MaxSSP];
+    // Profile, [NPts]; see extsetup_ssp()
+    real *z, *rho;
+    real *alphaR, *alphaI;
     // LP: Not actually used, but echoed, so with new system need to store them
-    real betaR[MaxSSP], betaI[MaxSSP];
+    real *betaR, *betaI;
+    SSPTable table;
+    UniformGrid gridX, gridY, gridZ; // Seg.x, Seg.y, Seg.z (hexahedral)
 
     int32_t NPts, Nr, Nx, Ny, Nz;
+    // Size of the profile arrays, set whenever they are (re)allocated: setup (2
+    // points without an env file), reading the env file, extsetup_ssp(),
+    // extsetup_ssp_quad(), and hexahedral preprocessing (from Seg.z)
+    int32_t NPtsAllocated;
     char Type;
     char AttenUnit[2];
     bool rangeInKm; // Ranges (R, X, Y) specified in km, will be automatically converted
@@ -169,12 +225,28 @@ template<bool O3D> struct BdryPtFull : public BdryPtFullExtras<O3D>,
 };
 template<bool O3D> constexpr int32_t BdryStride = sizeof(BdryPtFull<O3D>) / sizeof(real);
 
+/**
+ * The part of BdryPtFull which is read at every step (segment search and
+ * distance to the boundary), copied in preprocess into a compact array
+ * parallel to bd. The rest of BdryPtFull (geoacoustics, node tangents and
+ * normals, curvature) is only read when the ray changes segment or reflects.
+ */
+template<bool O3D> struct BdryPtHot {};
+template<> struct BdryPtHot<false> {
+    vec2 x, n;
+};
+template<> struct BdryPtHot<true> {
+    vec3 x, n1, n2;
+};
+
 template<bool O3D> struct BdryInfoTopBot {
     IORI2<O3D> NPts;
     char type[2];        // In 3D, only first char is used
     bool dirty;          // Set to indicate that derived values need updating
     bool rangeInKm;      // R, X, Y values in km; automatically converted to meters
     BdryPtFull<O3D> *bd; // 2D: 1D array / 3D: 2D array
+    BdryPtHot<O3D> *hot; // Same layout as bd, computed in preprocess
+    UniformGrid gridX, gridY; // 3D only
 };
 /**
  * LP: There are three boundary structures. This one represents static/global
@@ -314,6 +386,10 @@ struct FreqInfo {
     real freq0;    // Nominal or carrier frequency
     int32_t Nfreq; // number of frequencies
     real *freqVec; // frequency vector for broadband runs
+    /// LP: Not in BELLHOP(3D). Number of frequencies the TL field is computed
+    /// at: 1 (freq0), or Nfreq (freqVec) for broadband TL runs (see
+    /// bhcInit::broadbandTL). Set at the start of each run.
+    int32_t NFieldFreq;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -333,6 +409,14 @@ template<bool O3D> struct BeamStructure {
     bool rangeInKm;  // Box R, X, Y specified in km, converted to meters in preprocess
     bool autoDeltas; // stores whether deltas was automatically computed, for echo
     real deltas, epsMultiplier, rLoop;
+    // Adaptive step size (not in the env file): if stepTol > 0, the step
+    // length of each ray varies between deltasMin and deltasMax so that the
+    // estimated local error of each step stays below stepTol (m), starting from
+    // deltas. deltasMin / deltasMax of 0 default to deltas / 100 and 10 * deltas
+    // (applied at run time; they stay 0 here).
+    // Not supported with simple Gaussian beams (RunType[1] == 'S'), whose arc
+    // length assumes every step is deltas long.
+    real stepTol, deltasMin, deltasMax;
     VEC23<O3D> Box;
 };
 
@@ -379,10 +463,42 @@ struct Arrival {
  * LP: Arrival setup and results.
  */
 struct ArrInfo {
+    /// LP: Arena of arrivals, in blocks of ArrBlockSize (see arrivals.hpp).
+    /// Each receiver has a linked list of blocks; use GetArr() to access.
     Arrival *Arr;
+    /// LP: Per receiver: 1 + index of its first block, 0 if none.
+    int32_t *ArrHead;
+    /// LP: Per block: 1 + index of the next block of the same receiver, 0 if none.
+    int32_t *ArrNext;
+    /// LP: Number of blocks in the arena, and number in use (atomic counter).
+    int32_t NArrBlocks;
+    int32_t *NArrBlocksUsed;
     int32_t *NArr;
     int32_t *MaxNPerSource;
+    /// LP: Per-receiver spin locks, so that arrivals can be merged when
+    /// multithreaded. nullptr if not needed (single-threaded or not merging).
+    /// If there is not enough memory for these and LastArr, arrivals are not
+    /// merged (AllowMerging = false).
+    int32_t *Locks;
+    /// LP: For each worker and receiver, 1 + arena index of the last arrival
+    /// this worker wrote there, 0 if none. With multiple threads, the last arrival
+    /// at a receiver may be from another worker's ray; a new arrival is
+    /// instead checked against this worker's own last one, which is what it
+    /// would have been single-threaded. Allocated together with Locks.
+    int32_t *LastArr;
+    /// Maximum number of arrivals kept per receiver; beyond this (or when the
+    /// arena is full), new arrivals replace the weakest ones.
     int32_t MaxNArr;
+    /// LP: Top-K mode (bhcInit::maxArrivals): min-heaps of MaxNArr arena
+    /// indices, keyed on amplitude, for the receivers which are full.
+    /// HeapHead: per receiver, 1 + index of its heap, 0 if none yet.
+    /// HeapPos: per arena slot, position of the arrival in its heap.
+    /// All nullptr if not in top-K mode.
+    int32_t *Heap;
+    int32_t *HeapHead;
+    int32_t *HeapPos;
+    int32_t NHeaps;
+    int32_t *NHeapsUsed;
     bool AllowMerging;
 };
 
@@ -463,11 +579,20 @@ template<bool R3D> struct InfluenceRayInfo {
     cpx epsilon1, epsilon2; // beam constant
     VEC23<R3D> xs;          // source
     real freq0, omega;
+    // LP: Broadband TL: the field is also computed at these frequencies, in
+    // slabs of fieldSlab values (see FreqInfo::NFieldFreq).
+    int32_t NFieldFreq;
+    const real *freqVec;
+    size_t fieldSlab;
     real RadMax;
     real BeamWindow;
     int32_t iBeamWindow2;
     real Ratio1; // scale factor (point source vs. line source)
     real rcp_q0, rcp_qhat0;
+    // LP: No other thread writes to the field or arrivals this ray contributes
+    // to, so the contributions can be added without atomics or locks.
+    bool exclusiveField;
+    int32_t worker;
     // LP: Variables carried over between iterations.
     real phase;
     real qOld;               // LP: Det_QOld in 3D
@@ -494,6 +619,69 @@ struct bhcInit {
     /// more ray data in memory but is slower. This only affects ray and
     /// eigenray runs (no effect on TL or arrivals).
     bool useRayCopyMode = false;
+    /// For TL runs: if the field for all sources does not fit in half of the
+    /// remaining memory, process the sources in batches which do, and write
+    /// the SHD file batch by batch during run(). Then outputs.uAllSources only
+    /// holds the last batch, and bhc::writeout() does nothing for the field
+    /// (the file has already been written), except warn. run_poll() reports
+    /// the progress of the current batch. Requires a FileRoot, as the file is
+    /// written to FileRoot.shd.
+    bool streamTL = false;
+    /// For TL runs: compute the field at every frequency in freqVec, instead of
+    /// only at freq0. Each ray is traced once, and its contributions are
+    /// evaluated for all the frequencies. outputs.uAllSources then holds Nfreq
+    /// fields (one after another, in the order of freqVec), and the SHD file
+    /// holds the records for each frequency, in the same order. Requires
+    /// geometric (hat or Gaussian) beams, whose geometry and amplitude do not
+    /// depend on frequency. Attenuation along the ray, and the beam width
+    /// limit of Gaussian beams, are computed at freq0 and scaled with the
+    /// frequency, so attenuation must be in units proportional to frequency
+    /// (dB/wavelength, dB/(m kHz), Q, or loss parameter), without volume
+    /// attenuation; then each frequency's field matches a narrowband run at
+    /// that frequency (for hat beams). Also allows the broadband option
+    /// (TopOpt[5] == 'B') in the environment file, which reads freqVec;
+    /// otherwise it can be set with extsetup_freqvec().
+    bool broadbandTL = false;
+    /// For TL and arrivals runs: keep the rays traced by run() in
+    /// outputs.rayinfo, and on later runs apply the influence of the kept rays
+    /// instead of tracing them again, as long as nothing the ray paths depend
+    /// on has changed. This is for computing the field of one environment for
+    /// several receiver layouts, run types (TL coherent / incoherent,
+    /// arrivals), or influence types. The rays are traced again if the
+    /// sources, ray angles, frequency, beam box / step size, reflection /
+    /// beam shift options, semi-coherent option, boundary conditions,
+    /// reflection coefficients, or source beam pattern change, or if the SSP
+    /// or boundary dirty flags are set. Ray and eigenray runs overwrite the
+    /// kept rays. Not used with Cerveny beams, which need the SSP along the
+    /// ray, or with streaming TL (see streamTL). The rays count against
+    /// maxMemory; for arrivals runs, this needs maxArrivals > 0, as otherwise
+    /// the arrivals take all the remaining memory. CPU builds only.
+    bool rayCache = false;
+    /// For cubic spline and PCHIP SSPs: evaluate the SSP from a table on a
+    /// uniform depth grid (see SSPTable), built when the SSP is preprocessed,
+    /// instead of from the complex-valued polynomial of each layer. The cell is
+    /// found by direct indexing and evaluated in real arithmetic; the
+    /// attenuation is only evaluated if the SSP has any. The grid spacing is a
+    /// quarter of the thinnest layer, up to MaxSSPTable cells. Cells which
+    /// contain an SSP point, where the ray's layer depends on its direction,
+    /// use the polynomial of the layer. The results are the same as without
+    /// the table up to rounding.
+    bool sspTable = false;
+    /// If true, pin each worker thread to one logical core, so that workers do
+    /// not migrate between cores or sockets during a run. Worker i is pinned to
+    /// logical core (firstCore + i) modulo the number of logical cores. The
+    /// output arrays are always first touched (zeroed) in parallel by the
+    /// workers, so with pinning they end up spread over the NUMA nodes the
+    /// workers run on. Currently only implemented on Linux; ignored elsewhere.
+    bool pinThreads = false;
+    /// First logical core to pin workers to, see pinThreads.
+    int32_t firstCore = 0;
+    /// For arrivals runs: if > 0, keep only the maxArrivals strongest arrivals
+    /// at each receiver. Each receiver which fills up gets a min-heap keyed on
+    /// amplitude, so replacing its weakest arrival is O(log maxArrivals), and
+    /// the memory for arrivals is bounded by maxArrivals per receiver. If 0,
+    /// receivers keep as many arrivals as fit in memory.
+    int32_t maxArrivals = 0;
     /// Index of the GPU to use (ignored if not in CUDA mode). This is the order
     /// the GPUs are enumerated in CUDA, usually with the most powerful GPU
     /// as index 0.
@@ -561,4 +749,22 @@ template<bool O3D, bool R3D> struct bhcOutputs {
     ArrInfo *arrinfo;
 };
 
+/**
+ * Handle to a run started with bhc::run_async(). Only use it through
+ * run_poll(), run_wait(), and run_cancel(). internal is nullptr if the run
+ * could not be started.
+ */
+struct bhcRunHandle {
+    void *internal = nullptr;
+};
+
+/**
+ * Handle to an SHD file opened with bhc::shd_open(). Only use it through
+ * shd_row() and shd_close(). internal is nullptr if the file could not be
+ * opened.
+ */
+struct bhcShdView {
+    void *internal = nullptr;
+};
+
 } // namespace bhc
@@ -17,6 +17,7 @@ You should have received a copy of the GNU General Public License along with
 this program. If not, see <https://www.gnu.org/licenses/>.
 */
 #include "common_setup.hpp"
+#include "common_run.hpp"
 
 #include "module/paramsmodule.hpp"
 #include "module/atten.hpp"
@@ -381,7 +382,56 @@ template<bool O3D, bool R3D> inline mode::ModeModule<O3D, R3D> *GetMode(
     }
 }
 
-template<bool O3D, bool R3D> bool run(
+template<bool O3D> inline void CheckCancelled(const bhcParams<O3D> &params)
+{
+    if(GetInternal(params)->cancelRun.load(std::memory_order_relaxed)) {
+        EXTERR("Run cancelled");
+    }
+}
+
+/**
+ * Fills GetInternal(params)->runConsts, after the modules' preprocessing.
+ */
+template<bool O3D> void SetupRunConstants(bhcParams<O3D> &params)
+{
+    RunConstants &rc              = GetInternal(params)->runConsts;
+    const AnglesStructure *Angles = params.Angles;
+    const SBPInfo *sbp            = params.sbp;
+
+    // Source beam pattern, by linear interpolation in the table (see RayInit)
+    trackallocate(params, "source beam pattern amplitudes", rc.srcAmp, Angles->alpha.n);
+    for(int32_t ialpha = 0; ialpha < Angles->alpha.n; ++ialpha) {
+        real SrcDeclAngle = RadDeg * Angles->alpha.angles[ialpha];
+        int32_t ibp       = BinarySearchLEQ(
+            sbp->SrcBmPat, sbp->NSBPPts, 2, 0, SrcDeclAngle);
+        // LP: Our function won't ever go outside the table, but we need to limit it
+        // to 2 from the end.
+        ibp               = bhc::min(ibp, sbp->NSBPPts - 2);
+        real s            = (SrcDeclAngle - sbp->SrcBmPat[2 * ibp + 0])
+            / (sbp->SrcBmPat[2 * (ibp + 1) + 0] - sbp->SrcBmPat[2 * ibp + 0]);
+        rc.srcAmp[ialpha] = (FL(1.0) - s) * sbp->SrcBmPat[2 * ibp + 1]
+            + s * sbp->SrcBmPat[2 * (ibp + 1) + 1];
+    }
+
+    rc.hMin     = INFINITESIMAL_STEP_SIZE * params.Beam->deltas;
+    rc.adaptive = params.Beam->stepTol > RL(0.0);
+    GetStepBounds<O3D>(params.Beam, rc.deltasMin, rc.deltasMax);
+
+    if constexpr(O3D) {
+        const BdryInfoTopBot<O3D> &bot = params.bdinfo->bot;
+        const BdryInfoTopBot<O3D> &top = params.bdinfo->top;
+        rc.bdryMinX = bhc::max(bot.hot[0].x.x, top.hot[0].x.x);
+        rc.bdryMinY = bhc::max(bot.hot[0].x.y, top.hot[0].x.y);
+        rc.bdryMaxX = bhc::min(
+            bot.hot[(bot.NPts.x - 1) * bot.NPts.y].x.x,
+            top.hot[(top.NPts.x - 1) * top.NPts.y].x.x);
+        rc.bdryMaxY = bhc::min(bot.hot[bot.NPts.y - 1].x.y, top.hot[top.NPts.y - 1].x.y);
+    } else {
+        rc.bdryMinX = rc.bdryMinY = rc.bdryMaxX = rc.bdryMaxY = RL(0.0);
+    }
+}
+
+template<bool O3D, bool R3D> bool RunInternal(
     bhcParams<O3D> &params, bhcOutputs<O3D, R3D> &outputs)
 {
     try {
@@ -389,15 +439,23 @@ template<bool O3D, bool R3D> bool run(
 
         sw.tick();
         module::ModulesList<O3D> modules;
+        // Rays kept by bhcInit::rayCache are invalid if the environment changed
+        if(params.ssp->dirty || params.bdinfo->top.dirty || params.bdinfo->bot.dirty) {
+            GetInternal(params)->rayCacheKey.clear();
+        }
         for(auto *m : modules.list()) m->Validate(params);
         for(auto *m : modules.list()) m->Preprocess(params);
+        // Before the mode, which may take all remaining memory (arrivals)
+        SetupRunConstants<O3D>(params);
         auto *mo = GetMode<O3D, R3D>(params);
         mo->Preprocess(params, outputs);
         sw.tock("Preprocess");
+        CheckCancelled(params);
 
         sw.tick();
         mo->Run(params, outputs);
         sw.tock("Run");
+        CheckCancelled(params);
 
         sw.tick();
         mo->Postprocess(params, outputs);
@@ -412,6 +470,17 @@ template<bool O3D, bool R3D> bool run(
     return true;
 }
 
+template<bool O3D, bool R3D> bool run(
+    bhcParams<O3D> &params, bhcOutputs<O3D, R3D> &outputs)
+{
+    if(GetInternal(params)->asyncThread.joinable()) {
+        EXTWARN("bhc::run(): a run_async() is in progress, call run_wait() first\n");
+        return false;
+    }
+    GetInternal(params)->cancelRun = false;
+    return RunInternal(params, outputs);
+}
+
 #if BHC_ENABLE_2D
 template bool BHC_API
 run<false, false>(bhcParams<false> &params, bhcOutputs<false, false> &outputs);
@@ -425,6 +494,136 @@ template bool BHC_API
 run<true, true>(bhcParams<true> &params, bhcOutputs<true, true> &outputs);
 #endif
 
+template<bool O3D, bool R3D> bhcRunHandle run_async(
+    bhcParams<O3D> &params, bhcOutputs<O3D, R3D> &outputs)
+{
+    bhcRunHandle handle;
+    bhcInternal *internal = GetInternal(params);
+    if(internal->asyncThread.joinable()) {
+        EXTWARN("bhc::run_async(): a run is already in progress, call run_wait() "
+                "first\n");
+        return handle;
+    }
+    internal->cancelRun   = false;
+    internal->sharedJobID = 0;
+    internal->totalJobs   = 0;
+    internal->asyncDone   = false;
+    try {
+        internal->asyncThread = std::thread([&params, &outputs, internal]() {
+            internal->asyncResult = RunInternal(params, outputs);
+            internal->asyncDone.store(true, std::memory_order_release);
+        });
+    } catch(const std::exception &e) {
+        EXTWARN("Exception caught in bhc::run_async(): %s\n", e.what());
+        internal->asyncDone = true;
+        return handle;
+    }
+    handle.internal = internal;
+    return handle;
+}
+
+#if BHC_ENABLE_2D
+template bhcRunHandle BHC_API
+run_async<false, false>(bhcParams<false> &params, bhcOutputs<false, false> &outputs);
+#endif
+#if BHC_ENABLE_NX2D
+template bhcRunHandle BHC_API
+run_async<true, false>(bhcParams<true> &params, bhcOutputs<true, false> &outputs);
+#endif
+#if BHC_ENABLE_3D
+template bhcRunHandle BHC_API
+run_async<true, true>(bhcParams<true> &params, bhcOutputs<true, true> &outputs);
+#endif
+
+extern BHC_API bool run_poll(bhcRunHandle handle, int32_t *jobsDone, int32_t *jobsTotal)
+{
+    bhcInternal *internal = reinterpret_cast<bhcInternal *>(handle.internal);
+    if(jobsDone != nullptr) {
+        *jobsDone = internal == nullptr ? 0 : internal->sharedJobID.load();
+    }
+    if(jobsTotal != nullptr) {
+        *jobsTotal = internal == nullptr ? 0 : internal->totalJobs.load();
+    }
+    if(internal == nullptr) return true;
+    return internal->asyncDone.load(std::memory_order_acquire);
+}
+
+extern BHC_API bool run_wait(bhcRunHandle handle)
+{
+    bhcInternal *internal = reinterpret_cast<bhcInternal *>(handle.internal);
+    if(internal == nullptr || !internal->asyncThread.joinable()) return false;
+    internal->asyncThread.join();
+    return internal->asyncResult;
+}
+
+extern BHC_API void run_cancel(bhcRunHandle handle)
+{
+    bhcInternal *internal = reinterpret_cast<bhcInternal *>(handle.internal);
+    if(internal != nullptr) internal->cancelRun = true;
+}
+
+template<bool O3D, bool R3D> bool run_batch(
+    bhcParams<O3D> *params, bhcOutputs<O3D, R3D> *outputs, int32_t count,
+    int32_t numThreads, bool *results)
+{
+    if(count <= 0) return true;
+    bool ok = true;
+    std::vector<char> started(count, 0);
+    for(int32_t i = 0; i < count; ++i) {
+        bhcInternal *internal = GetInternal(params[i]);
+        if(internal->asyncThread.joinable()) {
+            ExternalWarning(
+                internal,
+                "bhc::run_batch(): a run_async() is in progress, call run_wait() "
+                "first\n");
+            ok = false;
+            continue;
+        }
+        internal->cancelRun = false;
+        started[i]          = 1;
+    }
+    if(results != nullptr) {
+        for(int32_t i = 0; i < count; ++i) results[i] = false;
+    }
+    std::atomic<int32_t> next(0);
+    std::atomic<bool> allOk(ok);
+    {
+        SharedThreadPool shared(ModifyNumThreads(numThreads));
+        for(int32_t i = 0; i < count; ++i) {
+            if(started[i]) GetInternal(params[i])->pool.Attach(&shared);
+        }
+        shared.RunAll([&](int32_t) {
+            int32_t i;
+            while((i = next.fetch_add(1, std::memory_order_relaxed)) < count) {
+                if(!started[i]) continue;
+                bool r = RunInternal(params[i], outputs[i]);
+                if(results != nullptr) results[i] = r;
+                if(!r) allOk = false;
+            }
+        });
+        for(int32_t i = 0; i < count; ++i) {
+            if(started[i]) GetInternal(params[i])->pool.Attach(nullptr);
+        }
+    }
+    return allOk;
+}
+
+#if BHC_ENABLE_2D
+template bool BHC_API run_batch<false, false>(
+    bhcParams<false> *params, bhcOutputs<false, false> *outputs, int32_t count,
+    int32_t numThreads, bool *results);
+#endif
+#if BHC_ENABLE_NX2D
+template bool BHC_API run_batch<true, false>(
+    bhcParams<true> *params, bhcOutputs<true, false> *outputs, int32_t count,
+    int32_t numThreads, bool *results);
+#endif
+#if BHC_ENABLE_3D
+template bool BHC_API run_batch<true, true>(
+    bhcParams<true> *params, bhcOutputs<true, true> *outputs, int32_t count,
+    int32_t numThreads, bool *results);
+#endif
+
 template<bool O3D, bool R3D> bool writeout(
     const bhcParams<O3D> &params, const bhcOutputs<O3D, R3D> &outputs,
     const char *FileRoot)
@@ -490,11 +689,55 @@ template BHC_API bool readout<true, true>(
     bhcParams<true> &params, bhcOutputs<true, true> &outputs, const char *FileRoot);
 #endif
 
+template<bool O3D> bhcShdView shd_open(bhcParams<O3D> &params, const char *FileRoot)
+{
+    bhcShdView view;
+    try {
+        if(FileRoot == nullptr) { FileRoot = GetInternal(params)->FileRoot.c_str(); }
+        if(!IsTLRun(params.Beam)) { EXTERR("shd_open() requires a TL run type"); }
+        view.internal = mode::OpenSHDView<O3D>(params, FileRoot);
+        module::ModulesList<O3D> modules;
+        for(auto *m : modules.list()) m->Validate(params);
+    } catch(const std::exception &e) {
+        EXTWARN("Exception caught in bhc::shd_open(): %s\n", e.what());
+        shd_close(view);
+        view.internal = nullptr;
+    }
+    return view;
+}
+
+#if BHC_ENABLE_2D
+template BHC_API bhcShdView shd_open<false>(
+    bhcParams<false> &params, const char *FileRoot);
+#endif
+#if BHC_ENABLE_NX2D || BHC_ENABLE_3D
+template BHC_API bhcShdView shd_open<true>(bhcParams<true> &params, const char *FileRoot);
+#endif
+
+extern BHC_API const cpxf *shd_row(
+    bhcShdView view, int32_t isx, int32_t isy, int32_t itheta, int32_t isz, int32_t Irz,
+    int32_t ifreq)
+{
+    mode::SHDView *v = reinterpret_cast<mode::SHDView *>(view.internal);
+    if(v == nullptr) return nullptr;
+    return v->Row(isx, isy, itheta, isz, Irz, ifreq);
+}
+
+extern BHC_API void shd_close(bhcShdView view)
+{
+    delete reinterpret_cast<mode::SHDView *>(view.internal);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 template<bool O3D, bool R3D> void finalize(
     bhcParams<O3D> &params, bhcOutputs<O3D, R3D> &outputs)
 {
+    if(GetInternal(params)->asyncThread.joinable()) {
+        // Abandoned run_async()
+        GetInternal(params)->cancelRun = true;
+        GetInternal(params)->asyncThread.join();
+    }
     module::ModulesList<O3D> modules;
     mode::ModesList<O3D, R3D> modes;
     for(auto *m : modules.list()) m->Finalize(params);
@@ -513,6 +756,7 @@ template<bool O3D, bool R3D> void finalize(
     trackdeallocate(params, outputs.rayinfo);
     trackdeallocate(params, outputs.eigen);
     trackdeallocate(params, outputs.arrinfo);
+    trackdeallocate(params, GetInternal(params)->runConsts.srcAmp);
 
     if(GetInternal(params)->usedMemory != 0) {
         EXTWARN(
@@ -702,6 +946,18 @@ template BHC_API void extsetup_brc<false>(bhcParams<false> &params, int32_t NPts
 template BHC_API void extsetup_brc<true>(bhcParams<true> &params, int32_t NPts);
 #endif
 
+template<bool O3D> void extsetup_ssp(bhcParams<O3D> &params, int32_t NPts)
+{
+    module::SSP<O3D> pm;
+    pm.ExtSetupProfile(params, NPts);
+}
+#if BHC_ENABLE_2D
+template BHC_API void extsetup_ssp<false>(bhcParams<false> &params, int32_t NPts);
+#endif
+#if BHC_ENABLE_3D || BHC_ENABLE_NX2D
+template BHC_API void extsetup_ssp<true>(bhcParams<true> &params, int32_t NPts);
+#endif
+
 #if BHC_ENABLE_2D
 extern BHC_API void extsetup_ssp_quad(bhcParams<false> &params, int32_t NPts, int32_t Nr)
 {
@@ -21,6 +21,126 @@ this program. If not, see <https://www.gnu.org/licenses/>.
 
 namespace bhc {
 
+/**
+ * LP: Arrivals are stored in an arena of blocks of ArrBlockSize arrivals. Each
+ * receiver has a linked list of blocks (ArrInfo::ArrHead, ArrInfo::ArrNext),
+ * which is only extended when the receiver actually gets more arrivals. So
+ * receivers with few arrivals take little memory, and receivers near caustics
+ * can have as many arrivals as fit in the whole arena.
+ */
+constexpr int32_t ArrBlockSize = 8;
+
+/**
+ * Returns arrival iArr of receiver base. If allocate, missing blocks are taken
+ * from the arena and linked in; returns nullptr if the arena is full.
+ * Otherwise, the block must already exist.
+ *
+ * Concurrent calls for the same receiver are safe: a block is linked with a
+ * compare-and-swap, and the loser of a race uses the winner's block (its own
+ * block is then lost, which is rare and harmless).
+ */
+HOST_DEVICE inline Arrival *GetArr(
+    const ArrInfo *arrinfo, size_t base, int32_t iArr, bool allocate = false)
+{
+    int32_t *link = &arrinfo->ArrHead[base];
+    for(int32_t b = iArr / ArrBlockSize; true; --b) {
+        int32_t block = *(volatile int32_t *)link - 1;
+        if(block < 0) {
+            // LP: Checked first so the counter does not keep growing (and
+            // eventually overflow) once the arena is full.
+            if(!allocate
+               || *(volatile int32_t *)arrinfo->NArrBlocksUsed >= arrinfo->NArrBlocks) {
+                return nullptr;
+            }
+            int32_t newBlock = AtomicFetchAdd(arrinfo->NArrBlocksUsed, 1);
+            if(newBlock >= arrinfo->NArrBlocks) return nullptr;
+            arrinfo->ArrNext[newBlock] = 0;
+            int32_t old                = AtomicCAS(link, 0, newBlock + 1);
+            block                      = old == 0 ? newBlock : old - 1;
+        }
+        if(b == 0) {
+            return &arrinfo->Arr[(size_t)block * ArrBlockSize + iArr % ArrBlockSize];
+        }
+        link = &arrinfo->ArrNext[block];
+    }
+}
+
+/**
+ * Calls f(arrival) for the first narr arrivals of receiver base, in order.
+ */
+template<typename F> inline void ForEachArr(
+    const ArrInfo *arrinfo, size_t base, int32_t narr, F f)
+{
+    int32_t block = arrinfo->ArrHead[base] - 1;
+    for(int32_t iArr = 0; iArr < narr; ++iArr) {
+        if(iArr > 0 && iArr % ArrBlockSize == 0) block = arrinfo->ArrNext[block] - 1;
+        f(arrinfo->Arr[(size_t)block * ArrBlockSize + iArr % ArrBlockSize]);
+    }
+}
+
+/**
+ * Returns the first of the weakest of the narr arrivals of receiver base,
+ * nullptr if narr == 0.
+ */
+HOST_DEVICE inline Arrival *WeakestArr(const ArrInfo *arrinfo, size_t base, int32_t narr)
+{
+    Arrival *weakest = nullptr;
+    int32_t block    = arrinfo->ArrHead[base] - 1;
+    for(int32_t i = 0; i < narr; ++i) {
+        if(i > 0 && i % ArrBlockSize == 0) block = arrinfo->ArrNext[block] - 1;
+        Arrival *a = &arrinfo->Arr[(size_t)block * ArrBlockSize + i % ArrBlockSize];
+        if(weakest == nullptr || a->a < weakest->a) weakest = a;
+    }
+    return weakest;
+}
+
+/**
+ * Top-K mode: moves heap[i] down the min-heap until it is no stronger than its
+ * children, updating HeapPos. Used after the amplitude of heap[i] increased.
+ */
+HOST_DEVICE inline void ArrHeapSiftDown(const ArrInfo *arrinfo, int32_t *heap, int32_t i)
+{
+    const int32_t K = arrinfo->MaxNArr;
+    int32_t g       = heap[i];
+    float a         = arrinfo->Arr[g].a;
+    while(true) {
+        int32_t c = 2 * i + 1;
+        if(c >= K) break;
+        if(c + 1 < K && arrinfo->Arr[heap[c + 1]].a < arrinfo->Arr[heap[c]].a) ++c;
+        if(!(arrinfo->Arr[heap[c]].a < a)) break;
+        heap[i]                   = heap[c];
+        arrinfo->HeapPos[heap[i]] = i;
+        i                         = c;
+    }
+    heap[i]             = g;
+    arrinfo->HeapPos[g] = i;
+}
+
+/**
+ * Top-K mode: returns the heap of receiver base, which must have MaxNArr
+ * arrivals. The heap is built the first time. Returns nullptr if there are no
+ * heaps left (then the caller falls back to WeakestArr()).
+ */
+HOST_DEVICE inline int32_t *GetArrHeap(const ArrInfo *arrinfo, size_t base)
+{
+    const int32_t K = arrinfo->MaxNArr;
+    int32_t h       = arrinfo->HeapHead[base] - 1;
+    if(h >= 0) return &arrinfo->Heap[(size_t)h * K];
+    if(*(volatile int32_t *)arrinfo->NHeapsUsed >= arrinfo->NHeaps) return nullptr;
+    h = AtomicFetchAdd(arrinfo->NHeapsUsed, 1);
+    if(h >= arrinfo->NHeaps) return nullptr;
+    int32_t *heap = &arrinfo->Heap[(size_t)h * K];
+    int32_t block = arrinfo->ArrHead[base] - 1;
+    for(int32_t i = 0; i < K; ++i) {
+        if(i > 0 && i % ArrBlockSize == 0) block = arrinfo->ArrNext[block] - 1;
+        heap[i]                   = block * ArrBlockSize + i % ArrBlockSize;
+        arrinfo->HeapPos[heap[i]] = i;
+    }
+    for(int32_t i = K / 2 - 1; i >= 0; --i) ArrHeapSiftDown(arrinfo, heap, i);
+    arrinfo->HeapHead[base] = h + 1;
+    return heap;
+}
+
 /**
  * Is this the second step of a pair (on the same ray)?
  * If so, we want to combine the arrivals to conserve space.
@@ -29,103 +149,152 @@ namespace bhc {
  * not joined)
  */
 template<bool R3D> HOST_DEVICE inline bool IsSecondStepOfPair(
-    real omega, real Phase, cpx delay, Arrival *baseArr, int32_t Nt)
+    real omega, real Phase, cpx delay, const Arrival *prev)
 {
     // arrivals with essentially the same phase are grouped into one
     const float PhaseTol = /*R3D ? FL(0.5) :*/ FL(0.05); // LP: 0.5 for 2D removed by mbp
                                                          // in 2022 revisions.
-    return Nt >= 1 && omega * STD::abs(delay - Cpxf2Cpx(baseArr[Nt - 1].delay)) < PhaseTol
-        && STD::abs(baseArr[Nt - 1].Phase - Phase) < PhaseTol;
+    return prev != nullptr && omega * STD::abs(delay - Cpxf2Cpx(prev->delay)) < PhaseTol
+        && STD::abs(prev->Phase - Phase) < PhaseTol;
+}
+
+HOST_DEVICE inline void SetArr(
+    Arrival *arr, real Amp, real Phase, cpx delay, const RayInitInfo &rinit,
+    real RcvrDeclAngle, real RcvrAzimAngle, int32_t NumTopBnc, int32_t NumBotBnc)
+{
+    arr->a             = (float)Amp;                // amplitude
+    arr->Phase         = (float)Phase;              // phase
+    arr->delay         = Cpx2Cpxf(delay);           // delay time
+    arr->SrcDeclAngle  = (float)rinit.SrcDeclAngle; // launch angle from source
+    arr->SrcAzimAngle  = (float)rinit.SrcAzimAngle; // launch angle from source
+    arr->RcvrDeclAngle = (float)RcvrDeclAngle;      // angle ray reaches receiver
+    arr->RcvrAzimAngle = (float)RcvrAzimAngle;      // angle ray reaches receiver
+    arr->NTopBnc       = NumTopBnc;                 // Number of top    bounces
+    arr->NBotBnc       = NumBotBnc;                 //   "       bottom
+}
+
+/**
+ * AddArr with merging of pairs and replacement of the weakest arrival.
+ * Must not be run concurrently for the same receiver.
+ *
+ * lastArr: see ArrInfo::LastArr; nullptr to use the last arrival at the receiver.
+ */
+template<bool R3D> HOST_DEVICE inline void AddArrMerging(
+    real Amp, real omega, real Phase, cpx delay, const RayInitInfo &rinit,
+    real RcvrDeclAngle, real RcvrAzimAngle, int32_t NumTopBnc, int32_t NumBotBnc,
+    const ArrInfo *arrinfo, size_t base, int32_t *lastArr)
+{
+    // LP: BUG: This only checks the last arrival, whereas the first step of the
+    // pair could have been placed in previous slots. See the Fortran version readme.
+
+    int32_t Nt = arrinfo->NArr[base]; // # of arrivals
+    Arrival *prev;
+    if(lastArr != nullptr) {
+        prev = *lastArr > 0 ? &arrinfo->Arr[*lastArr - 1] : nullptr;
+    } else {
+        prev = Nt > 0 ? GetArr(arrinfo, base, Nt - 1) : nullptr;
+    }
+
+    if(!IsSecondStepOfPair<R3D>(omega, Phase, delay, prev)) {
+        Arrival *arr  = nullptr;
+        int32_t *heap = nullptr;
+        if(Nt < arrinfo->MaxNArr) {
+            arr = GetArr(arrinfo, base, Nt, true);
+            if(arr != nullptr) arrinfo->NArr[base] = Nt + 1; // # of arrivals
+        } else if(arrinfo->Heap != nullptr) {
+            heap = GetArrHeap(arrinfo, base);
+        }
+        if(arr == nullptr) { // space not available to add an arrival?
+            // replace weakest arrival
+            arr = heap != nullptr ? &arrinfo->Arr[heap[0]]
+                                  : WeakestArr(arrinfo, base, Nt);
+            // LP: current arrival is weaker than all stored
+            if(arr == nullptr || !(arr->a < Amp)) return;
+        }
+        SetArr(
+            arr, Amp, Phase, delay, rinit, RcvrDeclAngle, RcvrAzimAngle, NumTopBnc,
+            NumBotBnc);
+        if(heap != nullptr) ArrHeapSiftDown(arrinfo, heap, 0);
+        if(lastArr != nullptr) *lastArr = (int32_t)(arr - arrinfo->Arr) + 1;
+    } else { // not a new ray
+        // PhaseArr[<base> + Nt-1] = PhaseArr[<base> + Nt-1] // LP: ???
+
+        // calculate weightings of old ray information vs. new, based on amplitude of
+        // the arrival
+        float AmpTot = prev->a + (float)Amp;
+        float w1     = prev->a / AmpTot;
+        float w2     = (float)Amp / AmpTot;
+
+        prev->delay         = w1 * prev->delay + w2 * Cpx2Cpxf(delay); // weighted sum
+        prev->a             = AmpTot;
+        prev->SrcDeclAngle  = w1 * prev->SrcDeclAngle + w2 * (float)rinit.SrcDeclAngle;
+        prev->SrcAzimAngle  = w1 * prev->SrcAzimAngle + w2 * (float)rinit.SrcAzimAngle;
+        prev->RcvrDeclAngle = w1 * prev->RcvrDeclAngle + w2 * (float)RcvrDeclAngle;
+        prev->RcvrAzimAngle = w1 * prev->RcvrAzimAngle + w2 * (float)RcvrAzimAngle;
+
+        // Top-K mode: the merged arrival got stronger
+        if(arrinfo->HeapHead != nullptr && arrinfo->HeapHead[base] != 0) {
+            size_t h      = (size_t)(arrinfo->HeapHead[base] - 1);
+            int32_t *heap = &arrinfo->Heap[h * arrinfo->MaxNArr];
+            ArrHeapSiftDown(arrinfo, heap, arrinfo->HeapPos[prev - arrinfo->Arr]);
+        }
+    }
 }
 
 /**
  * Adds the amplitude and delay for an ARRival into a matrix of same.
  * Extra logic included to keep only the strongest arrivals.
+ *
+ * exclusive: no other thread adds arrivals for this source, see
+ * InfluenceRayInfo::exclusiveField.
  */
 template<bool R3D> HOST_DEVICE inline void AddArr(
     int32_t itheta, int32_t id, int32_t ir, real Amp, real omega, real Phase, cpx delay,
     const RayInitInfo &rinit, real RcvrDeclAngle, real RcvrAzimAngle, int32_t NumTopBnc,
-    int32_t NumBotBnc, const ArrInfo *arrinfo, const Position *Pos)
+    int32_t NumBotBnc, const ArrInfo *arrinfo, const Position *Pos, int32_t worker,
+    bool exclusive)
 {
-    size_t base      = GetFieldAddr(rinit.isx, rinit.isy, rinit.isz, itheta, id, ir, Pos);
-    Arrival *baseArr = &arrinfo->Arr[base * arrinfo->MaxNArr];
-    int32_t *baseNArr = &arrinfo->NArr[base];
-    int32_t Nt;
+    size_t base = GetFieldAddr(rinit.isx, rinit.isy, rinit.isz, itheta, id, ir, Pos);
 
     if(arrinfo->AllowMerging) {
-        // LP: BUG: This only checks the last arrival, whereas the first step of the
-        // pair could have been placed in previous slots. See the Fortran version readme.
-
-        Nt = *baseNArr; // # of arrivals
-
-        if(!IsSecondStepOfPair<R3D>(omega, Phase, delay, baseArr, Nt)) {
-            int32_t iArr;
-            if(Nt >= arrinfo->MaxNArr) { // space not available to add an arrival?
-                // replace weakest arrival
-                iArr         = -1;
-                real weakest = Amp;
-                for(Nt = 0; Nt < arrinfo->MaxNArr; ++Nt) {
-                    if(baseArr[Nt].a < weakest) {
-                        weakest = baseArr[Nt].a;
-                        iArr    = Nt;
-                    }
-                }
-                if(iArr < 0) return; // LP: current arrival is weaker than all stored
-            } else {
-                iArr      = Nt;
-                *baseNArr = Nt + 1; // # of arrivals
-            }
-            baseArr[iArr].a            = (float)Amp;                // amplitude
-            baseArr[iArr].Phase        = (float)Phase;              // phase
-            baseArr[iArr].delay        = Cpx2Cpxf(delay);           // delay time
-            baseArr[iArr].SrcDeclAngle = (float)rinit.SrcDeclAngle; // launch angle from
-                                                                    // source
-            baseArr[iArr].SrcAzimAngle = (float)rinit.SrcAzimAngle; // launch angle from
-                                                                    // source
-            baseArr[iArr].RcvrDeclAngle = (float)RcvrDeclAngle;     // angle ray reaches
-                                                                    // receiver
-            baseArr[iArr].RcvrAzimAngle = (float)RcvrAzimAngle;     // angle ray reaches
-                                                                    // receiver
-            baseArr[iArr].NTopBnc = NumTopBnc; // Number of top    bounces
-            baseArr[iArr].NBotBnc = NumBotBnc; //   "       bottom
-        } else {                               // not a new ray
-            // PhaseArr[<base> + Nt-1] = PhaseArr[<base> + Nt-1] // LP: ???
-
-            // calculate weightings of old ray information vs. new, based on amplitude of
-            // the arrival
-            float AmpTot = baseArr[Nt - 1].a + (float)Amp;
-            float w1     = baseArr[Nt - 1].a / AmpTot;
-            float w2     = (float)Amp / AmpTot;
-
-            baseArr[Nt - 1].delay = w1 * baseArr[Nt - 1].delay
-                + w2 * Cpx2Cpxf(delay); // weighted sum
-            baseArr[Nt - 1].a            = AmpTot;
-            baseArr[Nt - 1].SrcDeclAngle = w1 * baseArr[Nt - 1].SrcDeclAngle
-                + w2 * (float)rinit.SrcDeclAngle;
-            baseArr[Nt - 1].SrcAzimAngle = w1 * baseArr[Nt - 1].SrcAzimAngle
-                + w2 * (float)rinit.SrcAzimAngle;
-            baseArr[Nt - 1].RcvrDeclAngle = w1 * baseArr[Nt - 1].RcvrDeclAngle
-                + w2 * (float)RcvrDeclAngle;
-            baseArr[Nt - 1].RcvrAzimAngle = w1 * baseArr[Nt - 1].RcvrAzimAngle
-                + w2 * (float)RcvrAzimAngle;
+        // LP: When multithreaded, the receiver is locked so that the merging
+        // and replacement see a consistent set of arrivals. The arrivals of
+        // different workers are interleaved at the receiver, so the pair check
+        // uses this worker's own last arrival (see ArrInfo::LastArr). When
+        // whole sources are given to each worker, neither is needed.
+        int32_t *lock = nullptr, *lastArr = nullptr;
+        if(!exclusive && arrinfo->Locks != nullptr) {
+            lock    = &arrinfo->Locks[base];
+            lastArr = &arrinfo->LastArr[(size_t)worker * GetFieldSize(Pos) + base];
         }
-
+        if(lock != nullptr) SpinLock(lock);
+        AddArrMerging<R3D>(
+            Amp, omega, Phase, delay, rinit, RcvrDeclAngle, RcvrAzimAngle, NumTopBnc,
+            NumBotBnc, arrinfo, base, lastArr);
+        if(lock != nullptr) SpinUnlock(lock);
     } else {
-        // LP: For multithreading mode, some mutex scheme would be needed to
-        // guarantee correct access to previously written data, which would
-        // destroy the performance on GPU. So just write the first
-        // arrinfo->MaxNArr arrivals and give up.
-        Nt = AtomicFetchAdd(baseNArr, 1);
-        if(Nt >= arrinfo->MaxNArr) return;
-        baseArr[Nt].a             = (float)Amp;                // amplitude
-        baseArr[Nt].Phase         = (float)Phase;              // phase
-        baseArr[Nt].delay         = Cpx2Cpxf(delay);           // delay time
-        baseArr[Nt].SrcDeclAngle  = (float)rinit.SrcDeclAngle; // launch angle from source
-        baseArr[Nt].SrcAzimAngle  = (float)rinit.SrcAzimAngle; // launch angle from source
-        baseArr[Nt].RcvrDeclAngle = (float)RcvrDeclAngle; // angle ray reaches receiver
-        baseArr[Nt].RcvrAzimAngle = (float)RcvrAzimAngle; // angle ray reaches receiver
-        baseArr[Nt].NTopBnc       = NumTopBnc;            // Number of top    bounces
-        baseArr[Nt].NBotBnc       = NumBotBnc;            //   "       bottom
+        // LP: On the GPU, the locking needed to guarantee correct access to
+        // previously written data would destroy the performance. So just write
+        // arrivals until the limit or the arena is full, and give up. The
+        // block for slot Nt is made to exist before Nt is claimed, so every
+        // claimed slot is written.
+        // Also used on the CPU when there is not enough memory for merging
+        // (see Arr::Preprocess).
+        int32_t *baseNArr = &arrinfo->NArr[base];
+        int32_t Nt        = *(volatile int32_t *)baseNArr;
+        while(true) {
+            if(Nt >= arrinfo->MaxNArr) return;
+            Arrival *arr = GetArr(arrinfo, base, Nt, true);
+            if(arr == nullptr) return;
+            int32_t old = AtomicCAS(baseNArr, Nt, Nt + 1);
+            if(old == Nt) {
+                SetArr(
+                    arr, Amp, Phase, delay, rinit, RcvrDeclAngle, RcvrAzimAngle,
+                    NumTopBnc, NumBotBnc);
+                return;
+            }
+            Nt = old;
+        }
     }
 }
 
@@ -71,41 +71,38 @@ template<bool O3D> HOST_DEVICE inline void GetBdrySeg(
     if constexpr(O3D) {
         // LP: See discussion of changes in Fortran version readme.
 
-        int32_t nx = bdinfotb->NPts.x;
-        int32_t ny = bdinfotb->NPts.y;
-        bds.Iseg.x = bhc::min(bhc::max(bds.Iseg.x, 0), nx - 2);
-        bds.Iseg.y = bhc::min(bhc::max(bds.Iseg.y, 0), ny - 2);
+        const BdryPtHot<true> *hot = bdinfotb->hot;
+        int32_t nx                 = bdinfotb->NPts.x;
+        int32_t ny                 = bdinfotb->NPts.y;
+        bds.Iseg.x = GridSegStart(x.x, bdinfotb->gridX, nx, bds.Iseg.x);
+        bds.Iseg.y = GridSegStart(x.y, bdinfotb->gridY, ny, bds.Iseg.y);
         if(t.x >= FL(0.0)) {
-            while(bds.Iseg.x >= 0 && bdinfotb->bd[(bds.Iseg.x) * ny].x.x > x.x)
-                --bds.Iseg.x;
+            while(bds.Iseg.x >= 0 && hot[(bds.Iseg.x) * ny].x.x > x.x) --bds.Iseg.x;
             while(bds.Iseg.x >= 0 && bds.Iseg.x < nx - 1
-                  && bdinfotb->bd[(bds.Iseg.x + 1) * ny].x.x <= x.x)
+                  && hot[(bds.Iseg.x + 1) * ny].x.x <= x.x)
                 ++bds.Iseg.x;
         } else {
-            while(bds.Iseg.x < nx - 1 && bdinfotb->bd[(bds.Iseg.x + 1) * ny].x.x < x.x)
+            while(bds.Iseg.x < nx - 1 && hot[(bds.Iseg.x + 1) * ny].x.x < x.x)
                 ++bds.Iseg.x;
             while(bds.Iseg.x >= 0 && bds.Iseg.x < nx - 1
-                  && bdinfotb->bd[(bds.Iseg.x) * ny].x.x >= x.x)
+                  && hot[(bds.Iseg.x) * ny].x.x >= x.x)
                 --bds.Iseg.x;
         }
         if(t.y >= FL(0.0)) {
-            while(bds.Iseg.y >= 0 && bdinfotb->bd[bds.Iseg.y].x.y > x.y) --bds.Iseg.y;
+            while(bds.Iseg.y >= 0 && hot[bds.Iseg.y].x.y > x.y) --bds.Iseg.y;
             while(bds.Iseg.y >= 0 && bds.Iseg.y < ny - 1
-                  && bdinfotb->bd[bds.Iseg.y + 1].x.y <= x.y)
+                  && hot[bds.Iseg.y + 1].x.y <= x.y)
                 ++bds.Iseg.y;
         } else {
-            while(bds.Iseg.y < ny - 1 && bdinfotb->bd[bds.Iseg.y + 1].x.y < x.y)
-                ++bds.Iseg.y;
-            while(bds.Iseg.y >= 0 && bds.Iseg.y < ny - 1
-                  && bdinfotb->bd[bds.Iseg.y].x.y >= x.y)
+            while(bds.Iseg.y < ny - 1 && hot[bds.Iseg.y + 1].x.y < x.y) ++bds.Iseg.y;
+            while(bds.Iseg.y >= 0 && bds.Iseg.y < ny - 1 && hot[bds.Iseg.y].x.y >= x.y)
                 --bds.Iseg.y;
         }
 
-        if(bds.Iseg.x == -1 && bdinfotb->bd[0].x.x == x.x) bds.Iseg.x = 0;
-        if(bds.Iseg.x == nx - 1 && bdinfotb->bd[(nx - 1) * ny].x.x == x.x)
-            bds.Iseg.x = nx - 2;
-        if(bds.Iseg.y == -1 && bdinfotb->bd[0].x.y == x.y) bds.Iseg.y = 0;
-        if(bds.Iseg.y == ny - 1 && bdinfotb->bd[ny - 1].x.y == x.y) bds.Iseg.y = ny - 2;
+        if(bds.Iseg.x == -1 && hot[0].x.x == x.x) bds.Iseg.x = 0;
+        if(bds.Iseg.x == nx - 1 && hot[(nx - 1) * ny].x.x == x.x) bds.Iseg.x = nx - 2;
+        if(bds.Iseg.y == -1 && hot[0].x.y == x.y) bds.Iseg.y = 0;
+        if(bds.Iseg.y == ny - 1 && hot[ny - 1].x.y == x.y) bds.Iseg.y = ny - 2;
 
         if(bds.Iseg.x < 0 || bds.Iseg.x >= nx - 1 || bds.Iseg.y < 0
            || bds.Iseg.y >= ny - 1) {
@@ -124,14 +121,13 @@ template<bool O3D> HOST_DEVICE inline void GetBdrySeg(
         }
 
         // segment limits in range
-        bds.lSeg.x.min = bdinfotb->bd[(bds.Iseg.x) * ny].x.x;
-        bds.lSeg.x.max = bdinfotb->bd[(bds.Iseg.x + 1) * ny].x.x;
-        bds.lSeg.y.min = bdinfotb->bd[bds.Iseg.y].x.y;
-        bds.lSeg.y.max = bdinfotb->bd[bds.Iseg.y + 1].x.y;
+        bds.lSeg.x.min = hot[(bds.Iseg.x) * ny].x.x;
+        bds.lSeg.x.max = hot[(bds.Iseg.x + 1) * ny].x.x;
+        bds.lSeg.y.min = hot[bds.Iseg.y].x.y;
+        bds.lSeg.y.max = hot[bds.Iseg.y + 1].x.y;
 
-        bds.x    = bdinfotb->bd[bds.Iseg.x * ny + bds.Iseg.y].x;
-        bds.xmid = (bds.x + bdinfotb->bd[(bds.Iseg.x + 1) * ny + (bds.Iseg.y + 1)].x)
-            * RL(0.5);
+        bds.x    = hot[bds.Iseg.x * ny + bds.Iseg.y].x;
+        bds.xmid = (bds.x + hot[(bds.Iseg.x + 1) * ny + (bds.Iseg.y + 1)].x) * RL(0.5);
 
         // printf("Iseg%s %d %d\n", isTop ? "Top" : "Bot", bds.Iseg.x+1, bds.Iseg.y+1);
         // printf("Bdryx %g,%g,%g x %g,%g,%g\n", bds.x.x, bds.x.y, bds.x.z, x.x, x.y,
@@ -156,9 +152,9 @@ template<bool O3D> HOST_DEVICE inline void GetBdrySeg(
         }
         bds.td.justSteppedTo = false;
         if(!bds.td.side) {
-            bds.n = bdinfotb->bd[bds.Iseg.x * ny + bds.Iseg.y].n1;
+            bds.n = hot[bds.Iseg.x * ny + bds.Iseg.y].n1;
         } else {
-            bds.n = bdinfotb->bd[bds.Iseg.x * ny + bds.Iseg.y].n2;
+            bds.n = hot[bds.Iseg.x * ny + bds.Iseg.y].n2;
         }
 
         // if the depth is bad (a NaN) then error out
@@ -178,16 +174,16 @@ template<bool O3D> HOST_DEVICE inline void GetBdrySeg(
         // LP: bdinfotb->bd.x is checked for being monotonic at load time, so we can
         // linearly search out from the last position, usually only have to move
         // by 1
-        int32_t n = bdinfotb->NPts;
-        bds.Iseg  = bhc::min(bhc::max(bds.Iseg, 0), n - 2);
+        const BdryPtHot<false> *hot = bdinfotb->hot;
+        int32_t n                   = bdinfotb->NPts;
+        bds.Iseg                    = bhc::min(bhc::max(bds.Iseg, 0), n - 2);
         if(t.x >= FL(0.0)) {
-            while(bds.Iseg >= 0 && bdinfotb->bd[bds.Iseg].x.x > x.x) --bds.Iseg;
-            while(bds.Iseg >= 0 && bds.Iseg < n - 1
-                  && bdinfotb->bd[bds.Iseg + 1].x.x <= x.x)
+            while(bds.Iseg >= 0 && hot[bds.Iseg].x.x > x.x) --bds.Iseg;
+            while(bds.Iseg >= 0 && bds.Iseg < n - 1 && hot[bds.Iseg + 1].x.x <= x.x)
                 ++bds.Iseg;
         } else {
-            while(bds.Iseg < n - 1 && bdinfotb->bd[bds.Iseg + 1].x.x < x.x) ++bds.Iseg;
-            while(bds.Iseg >= 0 && bds.Iseg < n - 1 && bdinfotb->bd[bds.Iseg].x.x >= x.x)
+            while(bds.Iseg < n - 1 && hot[bds.Iseg + 1].x.x < x.x) ++bds.Iseg;
+            while(bds.Iseg >= 0 && bds.Iseg < n - 1 && hot[bds.Iseg].x.x >= x.x)
                 --bds.Iseg;
         }
         if(bds.Iseg < 0 || bds.Iseg >= n - 1) {
@@ -203,14 +199,14 @@ template<bool O3D> HOST_DEVICE inline void GetBdrySeg(
             */
             bds.Iseg = 0;
         }
-        bds.lSeg.min = bdinfotb->bd[bds.Iseg].x.x;
-        bds.lSeg.max = bdinfotb->bd[bds.Iseg + 1].x.x;
+        bds.lSeg.min = hot[bds.Iseg].x.x;
+        bds.lSeg.max = hot[bds.Iseg + 1].x.x;
 
         // LP: Only explicitly loaded in this function in 3D, loaded in containing
         // code in 2D
-        bds.x = bdinfotb->bd[bds.Iseg].x;
+        bds.x = hot[bds.Iseg].x;
         // bds.xmid = (bds.x + bdinfotb->bd[bds.Iseg+1].x) * RL(0.5);
-        bds.n = bdinfotb->bd[bds.Iseg].n;
+        bds.n = hot[bds.Iseg].n;
 
         // LP: Moved from RayInit and RayUpdate (TraceRay2D)
         if(bdinfotb->type[1] == 'L') {
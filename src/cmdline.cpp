@@ -66,12 +66,26 @@ void showhelp(const char *argv0)
            "Nx2D\n"
 #endif
 #endif
+           "-pin, -pin=N: Pins each worker thread to one logical core, starting at\n"
+           "    core N (default 0). See bhcInit::pinThreads in <bhc/structs.hpp>\n"
+           "-stream, -streamtl: For TL runs which do not fit in memory, computes and\n"
+           "    writes the field in batches of sources. See bhcInit::streamTL in\n"
+           "    <bhc/structs.hpp>\n"
+           "-broadband: For TL runs, computes the field at all the frequencies of the\n"
+           "    broadband option (TopOpt[5] == 'B'). See bhcInit::broadbandTL in\n"
+           "    <bhc/structs.hpp>\n"
+           "-ssptable: For cubic spline and PCHIP SSPs, evaluates the SSP from a\n"
+           "    table on a uniform depth grid. See bhcInit::sspTable in\n"
+           "    <bhc/structs.hpp>\n"
            "-copy, -raycopy: Sets the behavior when there is insufficient memory to\n"
            "    allocate the requested number of full-size rays. See "
            "bhcInit::useRayCopyMode\n    in <bhc/structs.hpp> for more details\n"
 #if BHC_BUILD_CUDA
            "-gpu=N, -device=N: Selects CUDA device N\n"
 #endif
+           "-maxarr=K, -maxarrivals=K: For arrivals runs, keeps only the K strongest\n"
+           "    arrivals at each receiver. See bhcInit::maxArrivals in\n"
+           "    <bhc/structs.hpp>\n"
            "-mem=X, -memory=X: Sets the amount of memory " BHC_PROGRAMNAME
            " should use.\n"
            "    X may have a wide range of suffixes, examples: 16GiB, 8M, 100000kB\n"
@@ -100,6 +114,14 @@ int main(int argc, char **argv)
                 dimmode = 4;
             } else if(s == "-3" || s == "-3D") {
                 dimmode = 3;
+            } else if(s == "-pin") {
+                init.pinThreads = true;
+            } else if(s == "-stream" || s == "-streamtl") {
+                init.streamTL = true;
+            } else if(s == "-broadband") {
+                init.broadbandTL = true;
+            } else if(s == "-ssptable") {
+                init.sspTable = true;
             } else if(s == "-copy" || s == "-raycopy") {
                 init.useRayCopyMode = true;
             } else if(s == "-?" || s == "-h" || s == "-help") {
@@ -122,6 +144,23 @@ int main(int argc, char **argv)
                         return 1;
                     }
                     init.gpuIndex = std::stoi(value);
+                } else if(key == "-pin") {
+                    if(!bhc::isInt(value, false)) {
+                        std::cout << "Value \"" << value
+                                  << "\" for --pin argument is invalid, try " << argv[0]
+                                  << " --help\n";
+                        return 1;
+                    }
+                    init.pinThreads = true;
+                    init.firstCore  = std::stoi(value);
+                } else if(key == "-maxarr" || key == "-maxarrivals") {
+                    if(!bhc::isInt(value, false) || std::stoi(value) <= 0) {
+                        std::cout << "Value \"" << value
+                                  << "\" for --maxarrivals argument is invalid, try "
+                                  << argv[0] << " --help\n";
+                        return 1;
+                    }
+                    init.maxArrivals = std::stoi(value);
                 } else if(key == "-mem" || key == "-memory") {
                     size_t multiplier = 1u;
                     size_t base       = 1000u;
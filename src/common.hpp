@@ -40,6 +40,12 @@ this program. If not, see <https://www.gnu.org/licenses/>.
 #include <cstdarg>
 #include <chrono>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <vector>
+#include <deque>
 
 #define GLM_FORCE_EXPLICIT_CTOR 1
 #include <glm/common.hpp>
@@ -346,6 +352,37 @@ template<bool O3D> HOST_DEVICE inline int32_t GetNumJobs(
     return ret;
 }
 
+/**
+ * Number of sources which have their own rays (and their own part of the
+ * field). The jobs of each source are contiguous, see GetJobIndices.
+ */
+template<bool O3D> HOST_DEVICE inline int32_t GetNumSources(const Position *Pos)
+{
+    int32_t ret = Pos->NSz;
+    if constexpr(O3D) ret *= Pos->NSx * Pos->NSy;
+    return ret;
+}
+
+/**
+ * Adaptive step size bounds, with the defaults for Beam->deltasMin / deltasMax
+ * of 0 (see BeamStructure::stepTol).
+ */
+template<bool O3D> inline void GetStepBounds(
+    const BeamStructure<O3D> *Beam, real &deltasMin, real &deltasMax)
+{
+    deltasMin = Beam->deltasMin == RL(0.0) ? Beam->deltas * RL(0.01) : Beam->deltasMin;
+    deltasMax = Beam->deltasMax == RL(0.0) ? Beam->deltas * RL(10.0) : Beam->deltasMax;
+}
+
+/**
+ * Whether TL and arrivals runs give whole sources to each worker, so that no two
+ * workers write the same part of the outputs. See RunFieldModesImpl.
+ */
+template<bool O3D> inline bool FieldModesBySource(const Position *Pos, int32_t numThreads)
+{
+    return numThreads > 1 && GetNumSources<O3D>(Pos) >= numThreads;
+}
+
 /**
  * Returns whether the job should continue.
  * `is` changed to `isrc` because `is` is used for steps
@@ -378,6 +415,25 @@ template<bool O3D> HOST_DEVICE inline bool GetJobIndices(
     return (rinit.isz < Pos->NSz);
 }
 
+/**
+ * Number of complex values in the field (uAllSources) for all sources.
+ */
+HOST_DEVICE inline size_t GetFieldSize(const Position *Pos)
+{
+    return (size_t)Pos->NSz * (size_t)Pos->NSx * (size_t)Pos->NSy * (size_t)Pos->Ntheta
+        * (size_t)Pos->NRz_per_range * (size_t)Pos->NRr;
+}
+
+/**
+ * Number of complex values in uAllSources: the field for all sources, for each
+ * frequency of a broadband TL run.
+ */
+HOST_DEVICE inline size_t GetFieldSizeAllFreq(
+    const Position *Pos, const FreqInfo *freqinfo)
+{
+    return GetFieldSize(Pos) * (size_t)freqinfo->NFieldFreq;
+}
+
 HOST_DEVICE inline size_t GetFieldAddr(
     int32_t isx, int32_t isy, int32_t isz, int32_t itheta, int32_t id, int32_t ir,
     const Position *Pos)
@@ -398,6 +454,7 @@ HOST_DEVICE inline size_t GetFieldAddr(
 #include "util/errors.hpp"
 #include "util/prtfileemu.hpp"
 #include "util/timing.hpp"
+#include "util/threadpool.hpp"
 #include "runtype.hpp"
 #undef _BHC_INCLUDING_COMPONENTS_
 
@@ -407,30 +464,65 @@ namespace bhc {
 // Internal
 ////////////////////////////////////////////////////////////////////////////////
 
+/**
+ * Values which are the same for every ray of a run. Computed once per run after
+ * the modules are preprocessed (SetupRunConstants() in api.cpp), so that the ray
+ * trace does not redo this work for every ray or every step.
+ */
+struct RunConstants {
+    float *srcAmp; // [Angles->alpha.n] source beam pattern amplitude at each alpha
+    real hMin;     // smallest step, see ReduceStep and StepToBdry
+    bool adaptive; // Beam->stepTol > 0
+    // Adaptive step size bounds, with the defaults applied (GetStepBounds)
+    real deltasMin, deltasMax;
+    // 3D: region in x-y where both the altimetry and bathymetry are defined
+    real bdryMinX, bdryMinY, bdryMaxX, bdryMaxY;
+};
+
 struct bhcInternal {
     void (*outputCallback)(const char *message);
     std::string FileRoot;
     PrintFileEmu PRTFile;
-    std::atomic<int32_t> sharedJobID;
+    std::atomic<int32_t> sharedJobID; // jobs completed in the current phase
+    std::atomic<int32_t> totalJobs;   // jobs in the current phase
+    std::atomic<bool> cancelRun;
+    // For run_async()
+    std::thread asyncThread;
+    std::atomic<bool> asyncDone;
+    bool asyncResult;
     int gpuIndex, d_multiprocs; // d_warp, d_maxthreads
     int32_t numThreads;
+    int32_t maxArrivals;
     size_t maxMemory;
     size_t usedMemory;
     bool useRayCopyMode;
+    bool streamTL;
+    int32_t streamSources; // TL sources per batch when streaming, 0 if not
+    bool broadbandTL;
+    bool rayCache;
+    bool sspTable;
+    std::string rayCacheKey; // inputs of the rays in outputs.rayinfo, empty if none
+    RunConstants runConsts;
     bool noEnvFil;
     uint8_t dim;
+    ThreadPool pool;
 
     bhcInternal(const bhcInit &init, bool o3d, bool r3d)
         : outputCallback(init.outputCallback),
           FileRoot(
               init.FileRoot == nullptr ? "error_incorrect_use_of_" BHC_PROGRAMNAME
                                        : init.FileRoot),
-          PRTFile(this, this->FileRoot, init.prtCallback), gpuIndex(init.gpuIndex),
-          numThreads(ModifyNumThreads(init.numThreads)), maxMemory(init.maxMemory),
-          usedMemory(0), useRayCopyMode(init.useRayCopyMode),
-          noEnvFil(init.FileRoot == nullptr), dim(r3d       ? 3
-                                                      : o3d ? 4
-                                                            : 2)
+          PRTFile(this, this->FileRoot, init.prtCallback), sharedJobID(0), totalJobs(0),
+          cancelRun(false), asyncDone(true), asyncResult(false), gpuIndex(init.gpuIndex),
+          numThreads(ModifyNumThreads(init.numThreads)), maxArrivals(init.maxArrivals),
+          maxMemory(init.maxMemory), usedMemory(0), useRayCopyMode(init.useRayCopyMode),
+          streamTL(init.streamTL), streamSources(0), broadbandTL(init.broadbandTL),
+          rayCache(init.rayCache), sspTable(init.sspTable), runConsts(),
+          noEnvFil(init.FileRoot == nullptr),
+          dim(r3d       ? 3
+              : o3d ? 4
+                    : 2),
+          pool(numThreads, init.pinThreads ? init.firstCore : -1)
     {}
 };
 
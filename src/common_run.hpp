@@ -24,6 +24,12 @@ this program. If not, see <https://www.gnu.org/licenses/>.
 #include "util/atomics.hpp"
 #undef _BHC_INCLUDING_COMPONENTS_
 
+#ifdef BHC_USE_FLOATS
+#define INFINITESIMAL_STEP_SIZE (RL(1e-3))
+#else
+#define INFINITESIMAL_STEP_SIZE (RL(1e-6))
+#endif
+
 namespace bhc {
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -137,6 +143,22 @@ template<typename REAL> HOST_DEVICE inline int32_t BinarySearchGT(
     return hi;
 }
 
+/**
+ * Starting segment, in [0, n-2], for the search for the segment of a grid of n
+ * points containing x: computed directly if the grid is uniform, otherwise the
+ * previous segment iSeg. The search then only corrects for rounding and
+ * handles positions exactly on a grid point.
+ */
+HOST_DEVICE inline int32_t GridSegStart(
+    real x, const UniformGrid &grid, int32_t n, int32_t iSeg)
+{
+    if(grid.invDx != RL(0.0)) {
+        real s = (x - grid.x0) * grid.invDx;
+        return s >= RL(0.0) ? (s < (real)(n - 2) ? (int32_t)s : n - 2) : 0;
+    }
+    return bhc::min(bhc::max(iSeg, 0), n - 2);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Ray normals
 ////////////////////////////////////////////////////////////////////////////////
@@ -138,6 +138,7 @@ inline bool endswith(const std::string &source, const std::string &target)
 #include "util/ldio.hpp"
 #include "util/directio.hpp"
 #include "util/unformattedio.hpp"
+#include "util/mappedfile.hpp"
 #undef _BHC_INCLUDING_COMPONENTS_
 
 namespace bhc {
@@ -239,6 +240,30 @@ template<typename REAL> HOST_DEVICE inline bool monotonic(
     return true;
 }
 
+/**
+ * Spacing of the n monotonic points arr[i * stridereals + offset], for direct
+ * indexing (see UniformGrid). The grid counts as uniform if every point is
+ * within 1% of the spacing of its nominal position, so that the computed
+ * segment is off by at most one and the search only has to correct for that.
+ */
+template<typename REAL> inline UniformGrid DetectUniformGrid(
+    REAL *arr, int32_t n, const int32_t stridereals = 1, const int32_t offset = 0)
+{
+    CHECK_REAL_T();
+    UniformGrid grid;
+    grid.x0    = (real)arr[offset];
+    grid.invDx = RL(0.0);
+    if(n < 2) return grid;
+    real dx = ((real)arr[(n - 1) * stridereals + offset] - grid.x0) / (real)(n - 1);
+    if(!(dx > RL(0.0)) || !STD::isfinite(dx)) return grid;
+    for(int32_t i = 1; i < n - 1; ++i) {
+        real err = (real)arr[i * stridereals + offset] - (grid.x0 + (real)i * dx);
+        if(!(STD::abs(err) <= RL(0.01) * dx)) return grid;
+    }
+    grid.invDx = RL(1.0) / dx;
+    return grid;
+}
+
 /**
  * mbp: full 360-degree sweep? remove duplicate angle/beam
  */
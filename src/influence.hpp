@@ -426,7 +426,11 @@ template<bool R3D> HOST_DEVICE inline void AddToField(
 {
     size_t base = GetFieldAddr(
         inflray.init.isx, inflray.init.isy, inflray.init.isz, itheta, iz, ir, Pos);
-    AtomicAddCpx(&uAllSources[base], dfield);
+    if(inflray.exclusiveField) {
+        uAllSources[base] += dfield;
+    } else {
+        AtomicAddCpx(&uAllSources[base], dfield);
+    }
 }
 
 template<typename CFG, bool O3D, bool R3D> HOST_DEVICE inline void ApplyContribution(
@@ -444,27 +448,39 @@ template<typename CFG, bool O3D, bool R3D> HOST_DEVICE inline void ApplyContribu
         // arrivals
         AddArr<R3D>(
             itheta, iz, ir, cnst * w, omega, phaseInt, delay, inflray.init, RcvrDeclAngle,
-            RcvrAzimAngle, point1.NumTopBnc, point1.NumBotBnc, arrinfo, Pos);
+            RcvrAzimAngle, point1.NumTopBnc, point1.NumBotBnc, arrinfo, Pos,
+            inflray.worker, inflray.exclusiveField);
     } else {
-        cpxf dfield;
-        if(IsCoherentRun(Beam)) {
-            // coherent TL
-            dfield = Cpx2Cpxf(cnst * w * STD::exp(-J * (omega * delay - phaseInt)));
-            // printf("%20.17f %20.17f\n", dfield.real(), dfield.imag());
-            // omega * SQ(n) / (FL(2.0) * SQ(point1.c) * delay)))) // curvature correction
-            // [LP: 2D only]
-        } else {
-            // incoherent/semicoherent TL
-            real v = cnst * STD::exp((omega * delay).imag());
-            v      = SQ(v) * w;
-            if(IsGaussianGeomInfl(Beam)) {
-                // Gaussian beam
-                v *= GaussScaleFactor<R3D>();
+        // LP: For broadband TL, the ray and therefore cnst, w, and delay are the
+        // same for all frequencies; only the phase and the attenuation change.
+        // The field of frequency ifreq is slab ifreq of uAllSources.
+        for(int32_t ifreq = 0; ifreq < inflray.NFieldFreq; ++ifreq) {
+            if(inflray.NFieldFreq > 1) {
+                omega = FL(2.0) * REAL_PI * inflray.freqVec[ifreq];
+            }
+            cpxf dfield;
+            if(IsCoherentRun(Beam)) {
+                // coherent TL
+                dfield = Cpx2Cpxf(cnst * w * STD::exp(-J * (omega * delay - phaseInt)));
+                // printf("%20.17f %20.17f\n", dfield.real(), dfield.imag());
+                // omega * SQ(n) / (FL(2.0) * SQ(point1.c) * delay)))) // curvature
+                // correction [LP: 2D only]
+            } else {
+                // incoherent/semicoherent TL
+                real v = cnst * STD::exp((omega * delay).imag());
+                v      = SQ(v) * w;
+                if(IsGaussianGeomInfl(Beam)) {
+                    // Gaussian beam
+                    v *= GaussScaleFactor<R3D>();
+                }
+                dfield = cpxf((float)v, 0.0f);
             }
-            dfield = cpxf((float)v, 0.0f);
+            // printf("ApplyContribution dfield (%g,%g)\n", dfield.real(),
+            // dfield.imag());
+            AddToField<R3D>(
+                uAllSources + (size_t)ifreq * inflray.fieldSlab, dfield, itheta, ir, iz,
+                inflray, Pos);
         }
-        // printf("ApplyContribution dfield (%g,%g)\n", dfield.real(), dfield.imag());
-        AddToField<R3D>(uAllSources, dfield, itheta, ir, iz, inflray, Pos);
     }
 }
 
@@ -527,11 +543,14 @@ template<typename CFG, bool O3D, bool R3D> HOST_DEVICE inline void Init_Influenc
 {
     bool isGaussian = IsGaussianGeomInfl(Beam);
 
-    inflray.init  = rinit;
-    inflray.freq0 = freqinfo->freq0;
-    inflray.omega = FL(2.0) * REAL_PI * inflray.freq0;
-    inflray.c0    = point0.c;
-    inflray.xs    = point0.x;
+    inflray.init       = rinit;
+    inflray.freq0      = freqinfo->freq0;
+    inflray.omega      = FL(2.0) * REAL_PI * inflray.freq0;
+    inflray.NFieldFreq = freqinfo->NFieldFreq;
+    inflray.freqVec    = freqinfo->freqVec;
+    inflray.fieldSlab  = GetFieldSize(Pos);
+    inflray.c0         = point0.c;
+    inflray.xs         = point0.x;
     // LP: The 5x version is changed to 50x on both codepaths before it is used.
     // inflray.RadMax = FL(5.0) * ccpx.real() / freqinfo->freq0; // 5 wavelength max
     // radius
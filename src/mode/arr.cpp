@@ -21,54 +21,65 @@ this program. If not, see <https://www.gnu.org/licenses/>.
 
 namespace bhc { namespace mode {
 
+/**
+ * LP: The arrivals are processed and written in rows: all the ranges of one
+ * receiver depth (and bearing) for one source. The receivers of row r are at
+ * addresses r * NRr ... (r + 1) * NRr - 1, and the rows of source is are
+ * is * RowsPerSource ... (is + 1) * RowsPerSource - 1, where is is the index
+ * into MaxNPerSource.
+ */
+inline size_t RowsPerSource(const Position *Pos)
+{
+    return (size_t)Pos->Ntheta * (size_t)Pos->NRz_per_range;
+}
+
 template<bool O3D, bool R3D> void PostProcessArrivals(
     const bhcParams<O3D> &params, ArrInfo *arrinfo)
 {
     const Position *Pos = params.Pos;
-    for(int32_t isz = 0; isz < Pos->NSz; ++isz) {
-        for(int32_t isx = 0; isx < Pos->NSx; ++isx) {
-            for(int32_t isy = 0; isy < Pos->NSy; ++isy) {
-                int32_t maxn = 0; // LP: Maximum number of arrivals for this source
-                for(int32_t itheta = 0; itheta < Pos->Ntheta; ++itheta) {
-                    for(int32_t iz = 0; iz < Pos->NRz_per_range; ++iz) {
-                        for(int32_t ir = 0; ir < Pos->NRr; ++ir) {
-                            size_t base
-                                = GetFieldAddr(isx, isy, isz, itheta, iz, ir, Pos);
+    size_t nSrcs        = (size_t)Pos->NSz * Pos->NSx * Pos->NSy;
+    size_t nRows        = nSrcs * RowsPerSource(Pos);
+    // LP: Maximum number of arrivals for each row, combined per source below
+    std::vector<int32_t> rowMaxN(nRows);
 
-                            int32_t narr = arrinfo->NArr[base];
-                            if(narr > arrinfo->MaxNArr) {
-                                // For multithreading / AllowMerging == false where this
-                                // holds the total number of attempted arrivals,
-                                // including those not written due to limited memory
-                                arrinfo->NArr[base] = narr = arrinfo->MaxNArr;
-                            }
-                            maxn = bhc::max(maxn, narr);
-
-                            float factor;
-                            if constexpr(R3D) {
-                                factor = FL(1.0);
-                            } else {
-                                bool line = false; // Silence MSVC warning
-                                if constexpr(!O3D) line = IsLineSource(params.Beam);
-                                if(line) {
-                                    factor = FL(4.0) * STD::sqrt(REAL_PI);
-                                } else if(Pos->Rr[ir] == FL(0.0)) {
-                                    // avoid /0 at origin
-                                    factor = FL(1e5);
-                                } else {
-                                    // cyl. spreading
-                                    factor = FL(1.0) / STD::sqrt(Pos->Rr[ir]);
-                                }
-                            }
-                            for(int32_t iArr = 0; iArr < narr; ++iArr) {
-                                arrinfo->Arr[base * arrinfo->MaxNArr + iArr].a *= factor;
-                            }
-                        }
+    GetInternal(params)->pool.ForSlices(nRows, [&](size_t rowBegin, size_t rowEnd) {
+        for(size_t row = rowBegin; row < rowEnd; ++row) {
+            int32_t maxn = 0;
+            for(int32_t ir = 0; ir < Pos->NRr; ++ir) {
+                size_t base = row * (size_t)Pos->NRr + (size_t)ir;
+
+                int32_t narr = arrinfo->NArr[base];
+                maxn         = bhc::max(maxn, narr);
+
+                float factor;
+                if constexpr(R3D) {
+                    factor = FL(1.0);
+                } else {
+                    bool line = false; // Silence MSVC warning
+                    if constexpr(!O3D) line = IsLineSource(params.Beam);
+                    if(line) {
+                        factor = FL(4.0) * STD::sqrt(REAL_PI);
+                    } else if(Pos->Rr[ir] == FL(0.0)) {
+                        // avoid /0 at origin
+                        factor = FL(1e5);
+                    } else {
+                        // cyl. spreading
+                        factor = FL(1.0) / STD::sqrt(Pos->Rr[ir]);
                     }
                 }
-                arrinfo->MaxNPerSource[(isz * Pos->NSx + isx) * Pos->NSy + isy] = maxn;
+                ForEachArr(arrinfo, base, narr, [&](Arrival &arr) { arr.a *= factor; });
             }
+            rowMaxN[row] = maxn;
+        }
+    });
+
+    for(size_t is = 0; is < nSrcs; ++is) {
+        int32_t maxn = 0;
+        for(size_t row = is * RowsPerSource(Pos); row < (is + 1) * RowsPerSource(Pos);
+            ++row) {
+            maxn = bhc::max(maxn, rowMaxN[row]);
         }
+        arrinfo->MaxNPerSource[is] = maxn;
     }
 }
 
@@ -85,6 +96,78 @@ template void PostProcessArrivals<true, true>(
     const bhcParams<true> &params, ArrInfo *arrinfo);
 #endif
 
+/// Number of arrivals (plus receivers) formatted by one worker at a time.
+constexpr size_t ArrWritePieceSize = 65536;
+
+/**
+ * Writes the arrivals of rows [rowBegin, rowEnd) (see RowsPerSource), preceded
+ * by the maximum number of arrivals of the source at the first row of each
+ * source.
+ */
+template<bool O3D> void WriteArrivalsRows(
+    const bhcParams<O3D> &params, const ArrInfo *arrinfo, bool isAscii,
+    LDOFile &AARRFile, UnformattedOFile &BARRFile, size_t rowBegin, size_t rowEnd)
+{
+    const Position *Pos = params.Pos;
+    for(size_t row = rowBegin; row < rowEnd; ++row) {
+        if(row % RowsPerSource(Pos) == 0) {
+            // LP: Maximum number of arrivals for this source
+            int32_t maxn = arrinfo->MaxNPerSource[row / RowsPerSource(Pos)];
+            if(isAscii) {
+                AARRFile << maxn << '\n';
+            } else {
+                BARRFile.rec();
+                BARRFile.write(maxn);
+            }
+        }
+
+        for(int32_t ir = 0; ir < Pos->NRr; ++ir) {
+            size_t base  = row * (size_t)Pos->NRr + (size_t)ir;
+            int32_t narr = arrinfo->NArr[base];
+            if(isAscii) {
+                AARRFile << narr << '\n';
+            } else {
+                BARRFile.rec();
+                BARRFile.write(narr);
+            }
+
+            ForEachArr(arrinfo, base, narr, [&](const Arrival &arrv) {
+                const Arrival *arr = &arrv;
+                // LP: Unnecessary inconsistent casting to float; see Fortran
+                // version readme.
+                if(isAscii) {
+                    // You can compress the output file a lot by putting in an
+                    // explicit format statement here ... However, you'll need
+                    // to make sure you keep adequate precision
+                    AARRFile << arr->a;
+                    if constexpr(O3D) {
+                        AARRFile << RadDeg * arr->Phase;
+                    } else {
+                        AARRFile << (float)RadDeg * arr->Phase;
+                    }
+                    AARRFile << arr->delay.real() << arr->delay.imag()
+                             << arr->SrcDeclAngle;
+                    if constexpr(O3D) AARRFile << arr->SrcAzimAngle;
+                    AARRFile << arr->RcvrDeclAngle;
+                    if constexpr(O3D) AARRFile << arr->RcvrAzimAngle;
+                    AARRFile << arr->NTopBnc << arr->NBotBnc << '\n';
+                } else {
+                    BARRFile.rec();
+                    BARRFile.write(arr->a);
+                    BARRFile.write((float)(RadDeg * arr->Phase));
+                    BARRFile.write(arr->delay);
+                    BARRFile.write(arr->SrcDeclAngle);
+                    if constexpr(O3D) BARRFile.write(arr->SrcAzimAngle);
+                    BARRFile.write(arr->RcvrDeclAngle);
+                    if constexpr(O3D) BARRFile.write(arr->RcvrAzimAngle);
+                    BARRFile.write((float)arr->NTopBnc);
+                    BARRFile.write((float)arr->NBotBnc);
+                }
+            });
+        }
+    }
+}
+
 template<bool O3D> void WriteOutArrivals(
     const bhcParams<O3D> &params, const ArrInfo *arrinfo)
 {
@@ -166,72 +249,53 @@ template<bool O3D> void WriteOutArrivals(
     default: EXTERR("WriteOutArrivals called while not in arrivals mode");
     }
     // LP: originally most of WriteArrivals[ASCII/Binary][3D]
-    for(int32_t isz = 0; isz < Pos->NSz; ++isz) {
-        for(int32_t isx = 0; isx < Pos->NSx; ++isx) {
-            for(int32_t isy = 0; isy < Pos->NSy; ++isy) {
-                // LP: Maximum number of arrivals for this source
-                int32_t maxn
-                    = arrinfo->MaxNPerSource[(isz * Pos->NSx + isx) * Pos->NSy + isy];
-                if(isAscii) {
-                    AARRFile << maxn << '\n';
-                } else {
-                    BARRFile.rec();
-                    BARRFile.write(maxn);
-                }
-
-                for(int32_t itheta = 0; itheta < Pos->Ntheta; ++itheta) {
-                    for(int32_t iz = 0; iz < Pos->NRz_per_range; ++iz) {
-                        for(int32_t ir = 0; ir < Pos->NRr; ++ir) {
-                            size_t base
-                                = GetFieldAddr(isx, isy, isz, itheta, iz, ir, Pos);
-                            int32_t narr = arrinfo->NArr[base];
-                            if(isAscii) {
-                                AARRFile << narr << '\n';
-                            } else {
-                                BARRFile.rec();
-                                BARRFile.write(narr);
-                            }
-
-                            for(int32_t iArr = 0; iArr < narr; ++iArr) {
-                                Arrival *arr
-                                    = &arrinfo->Arr[base * arrinfo->MaxNArr + iArr];
-                                // LP: Unnecessary inconsistent casting to float; see
-                                // Fortran version readme.
-                                if(isAscii) {
-                                    // You can compress the output file a lot by putting
-                                    // in an explicit format statement here ... However,
-                                    // you'll need to make sure you keep adequate
-                                    // precision
-                                    AARRFile << arr->a;
-                                    if constexpr(O3D) {
-                                        AARRFile << RadDeg * arr->Phase;
-                                    } else {
-                                        AARRFile << (float)RadDeg * arr->Phase;
-                                    }
-                                    AARRFile << arr->delay.real() << arr->delay.imag()
-                                             << arr->SrcDeclAngle;
-                                    if constexpr(O3D) AARRFile << arr->SrcAzimAngle;
-                                    AARRFile << arr->RcvrDeclAngle;
-                                    if constexpr(O3D) AARRFile << arr->RcvrAzimAngle;
-                                    AARRFile << arr->NTopBnc << arr->NBotBnc << '\n';
-                                } else {
-                                    BARRFile.rec();
-                                    BARRFile.write(arr->a);
-                                    BARRFile.write((float)(RadDeg * arr->Phase));
-                                    BARRFile.write(arr->delay);
-                                    BARRFile.write(arr->SrcDeclAngle);
-                                    if constexpr(O3D) BARRFile.write(arr->SrcAzimAngle);
-                                    BARRFile.write(arr->RcvrDeclAngle);
-                                    if constexpr(O3D) BARRFile.write(arr->RcvrAzimAngle);
-                                    BARRFile.write((float)arr->NTopBnc);
-                                    BARRFile.write((float)arr->NBotBnc);
-                                }
-                            }
-                        }
-                    }
-                }
+    size_t nRows       = (size_t)Pos->NSz * Pos->NSx * Pos->NSy * RowsPerSource(Pos);
+    int32_t numThreads = GetInternal(params)->numThreads;
+    if(numThreads == 1) {
+        WriteArrivalsRows(params, arrinfo, isAscii, AARRFile, BARRFile, 0, nRows);
+        return;
+    }
+    // Multithreaded: the rows are split into pieces of about ArrWritePieceSize
+    // arrivals. Each worker formats one piece into memory, and then the pieces
+    // are written to the file in order, numThreads pieces at a time.
+    std::vector<size_t> pieces{0}; // row boundaries of the current pieces
+    std::vector<std::string> buffers(numThreads);
+    size_t pieceArrs = 0;
+    for(size_t row = 0; row < nRows; ++row) {
+        for(int32_t ir = 0; ir < Pos->NRr; ++ir) {
+            pieceArrs += 1 + arrinfo->NArr[row * (size_t)Pos->NRr + (size_t)ir];
+        }
+        bool last = row == nRows - 1;
+        if(pieceArrs >= ArrWritePieceSize || last) {
+            pieces.push_back(row + 1);
+            pieceArrs = 0;
+        }
+        if(pieces.size() < (size_t)numThreads + 1 && !(last && pieces.size() > 1)) {
+            continue;
+        }
+        GetInternal(params)->pool.Run([&](int32_t worker) {
+            if((size_t)worker + 1 >= pieces.size()) return;
+            LDOFile pieceA;
+            UnformattedOFile pieceB(GetInternal(params));
+            if(isAscii) {
+                pieceA.openmem();
+            } else {
+                pieceB.openmem();
             }
+            WriteArrivalsRows(
+                params, arrinfo, isAscii, pieceA, pieceB, pieces[worker],
+                pieces[worker + 1]);
+            buffers[worker] = isAscii ? pieceA.takemem() : pieceB.takemem();
+        });
+        for(size_t w = 0; w + 1 < pieces.size(); ++w) {
+            if(isAscii) {
+                AARRFile.writeraw(buffers[w]);
+            } else {
+                BARRFile.writeraw(buffers[w]);
+            }
+            buffers[w].clear();
         }
+        pieces.erase(pieces.begin(), pieces.end() - 1);
     }
 }
 
@@ -362,20 +426,22 @@ template<bool O3D, bool R3D> void ReadOutArrivals(
                                 = GetFieldAddr(isx, isy, isz, itheta, iz, ir, Pos);
                             int32_t narr;
                             ReadArrivalsValue(AARRFile, BARRFile, isAscii, narr, true);
-                            int32_t keep_narr = narr;
-                            if(narr > arrinfo->MaxNArr) {
-                                keep_narr = arrinfo->MaxNArr;
-                                EXTWARN(
-                                    "%d arrivals in file (source xyz %d,%d,%d "
-                                    "/ rcvr tzr %d,%d,%d), but only memory for %d",
-                                    isx, isy, isz, itheta, iz, ir, narr, keep_narr);
-                            }
-                            arrinfo->NArr[base] = keep_narr;
+                            int32_t keep_narr = 0;
                             for(int32_t iArr = 0; iArr < narr; ++iArr) {
-                                Arrival *arr;
-                                if(iArr < keep_narr) {
-                                    arr = &arrinfo->Arr[base * arrinfo->MaxNArr + iArr];
+                                Arrival *arr = nullptr;
+                                if(iArr == keep_narr && iArr < arrinfo->MaxNArr) {
+                                    arr = GetArr(arrinfo, base, iArr, true);
+                                }
+                                if(arr != nullptr) {
+                                    ++keep_narr;
                                 } else {
+                                    if(iArr == keep_narr) {
+                                        EXTWARN(
+                                            "%d arrivals in file (source xyz %d,%d,%d "
+                                            "/ rcvr tzr %d,%d,%d), but only memory for %d",
+                                            narr, isx, isy, isz, itheta, iz, ir,
+                                            keep_narr);
+                                    }
                                     arr = &dummy_arr;
                                 }
                                 ReadArrivalsValue(
@@ -414,6 +480,7 @@ template<bool O3D, bool R3D> void ReadOutArrivals(
                                     arr->NBotBnc = f2;
                                 }
                             }
+                            arrinfo->NArr[base] = keep_narr;
                         }
                     }
                 }
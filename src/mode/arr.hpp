@@ -54,10 +54,21 @@ public:
 
     virtual void Init(bhcOutputs<O3D, R3D> &outputs) const override
     {
-        outputs.arrinfo->Arr           = nullptr;
-        outputs.arrinfo->NArr          = nullptr;
-        outputs.arrinfo->MaxNPerSource = nullptr;
-        outputs.arrinfo->MaxNArr       = 1;
+        outputs.arrinfo->Arr            = nullptr;
+        outputs.arrinfo->ArrHead        = nullptr;
+        outputs.arrinfo->ArrNext        = nullptr;
+        outputs.arrinfo->NArrBlocks     = 0;
+        outputs.arrinfo->NArrBlocksUsed = nullptr;
+        outputs.arrinfo->NArr           = nullptr;
+        outputs.arrinfo->MaxNPerSource  = nullptr;
+        outputs.arrinfo->Locks          = nullptr;
+        outputs.arrinfo->LastArr        = nullptr;
+        outputs.arrinfo->MaxNArr        = 1;
+        outputs.arrinfo->Heap           = nullptr;
+        outputs.arrinfo->HeapHead       = nullptr;
+        outputs.arrinfo->HeapPos        = nullptr;
+        outputs.arrinfo->NHeaps         = 0;
+        outputs.arrinfo->NHeapsUsed     = nullptr;
     }
 
     virtual void Preprocess(
@@ -66,37 +77,119 @@ public:
         Field<O3D, R3D>::Preprocess(params, outputs);
         ArrInfo *arrinfo = outputs.arrinfo;
 
-        trackdeallocate(params, arrinfo->Arr);
-        trackdeallocate(params, arrinfo->NArr);
-        trackdeallocate(params, arrinfo->MaxNPerSource);
+        FreeArrivals(params, arrinfo);
+#ifdef BHC_BUILD_CUDA
         arrinfo->AllowMerging = GetInternal(params)->numThreads == 1;
-        size_t nSrcs          = params.Pos->NSx * params.Pos->NSy * params.Pos->NSz;
-        size_t nSrcsRcvrs     = nSrcs * params.Pos->Ntheta * params.Pos->NRr
+#else
+        // LP: Multithreaded CPU runs merge too, with per-receiver locks.
+        arrinfo->AllowMerging = true;
+#endif
+        int32_t numThreads  = GetInternal(params)->numThreads;
+        int32_t maxArrivals = GetInternal(params)->maxArrivals;
+        if(maxArrivals < 0) EXTERR("bhcInit::maxArrivals must be >= 0");
+        // Locks are not needed if the workers get whole sources
+        bool needLocks = arrinfo->AllowMerging && numThreads > 1
+            && !FieldModesBySource<O3D>(params.Pos, numThreads);
+        size_t nSrcs      = params.Pos->NSx * params.Pos->NSy * params.Pos->NSz;
+        size_t nSrcsRcvrs = nSrcs * params.Pos->Ntheta * params.Pos->NRr
             * params.Pos->NRz_per_range;
         int64_t remainingMemory = GetInternal(params)->maxMemory
             - GetInternal(params)->usedMemory;
-        remainingMemory -= nSrcsRcvrs * sizeof(int32_t);
+        // NArr, ArrHead, MaxNPerSource
+        remainingMemory -= nSrcsRcvrs * sizeof(int32_t) * 2;
         remainingMemory -= nSrcs * sizeof(int32_t);
-        remainingMemory -= 32 * 3; // Possible padding used for the three arrays
-        remainingMemory  = std::max(remainingMemory, (int64_t)0);
-        arrinfo->MaxNArr = (int32_t)std::min(
-            remainingMemory / (nSrcsRcvrs * sizeof(Arrival)), (size_t)0x7FFFFFFF);
-        if(arrinfo->MaxNArr == 0) {
+        remainingMemory -= 32 * 12; // Possible padding used for the twelve arrays
+        if(needLocks) {
+            // Locks, and the per-worker last arrivals (ArrInfo::LastArr), without
+            // which the merging would depend on the timing of the threads. If
+            // these do not leave room for any arrivals, do not merge.
+            int64_t mergeMemory = (int64_t)(
+                (1 + (size_t)numThreads) * nSrcsRcvrs * sizeof(int32_t));
+            if(remainingMemory - mergeMemory
+               >= (int64_t)(ArrBlockSize * sizeof(Arrival) + sizeof(int32_t))) {
+                remainingMemory -= mergeMemory;
+            } else {
+                EXTWARN(
+                    "Not enough memory to merge arrivals with %d threads, arrivals "
+                    "will not be merged",
+                    numThreads);
+                arrinfo->AllowMerging = false;
+                needLocks             = false;
+            }
+        }
+        // Top-K mode: heaps for the strongest arrivals. Not on the GPU, which
+        // does not replace arrivals (see AddArr).
+        bool useHeaps = arrinfo->AllowMerging && maxArrivals > 0;
+        if(useHeaps) remainingMemory -= nSrcsRcvrs * sizeof(int32_t); // HeapHead
+        remainingMemory = std::max(remainingMemory, (int64_t)0);
+        // The rest is the arena, shared by all receivers. In top-K mode, each
+        // arrival also needs its HeapPos and (at most) one heap entry, and no
+        // receiver ever needs more than K arrivals.
+        int64_t blockMemory = ArrBlockSize * sizeof(Arrival) + sizeof(int32_t);
+        if(useHeaps) blockMemory += 2 * ArrBlockSize * sizeof(int32_t);
+        // LP: Arena indices of arrivals must fit in int32_t (ArrInfo::LastArr).
+        int64_t nBlocks = std::min(
+            remainingMemory / blockMemory, (int64_t)0x7FFFFFFF / ArrBlockSize);
+        int64_t blocksPerRcvr = (maxArrivals + ArrBlockSize - 1) / ArrBlockSize;
+        if(maxArrivals > 0) {
+            nBlocks = std::min(nBlocks, (int64_t)nSrcsRcvrs * blocksPerRcvr);
+        }
+        arrinfo->NArrBlocks = (int32_t)nBlocks;
+        arrinfo->MaxNArr    = maxArrivals > 0 ? maxArrivals : 0x7FFFFFFF;
+        if(arrinfo->NArrBlocks == 0) {
             EXTERR("Insufficient memory to allocate arrivals");
-        } else if(arrinfo->MaxNArr < 10) {
+        } else if(
+            (size_t)arrinfo->NArrBlocks * ArrBlockSize
+            < nSrcsRcvrs * std::min(arrinfo->MaxNArr, 10)) {
             EXTWARN(
-                "Only enough memory to allocate up to %d arrivals per receiver",
-                arrinfo->MaxNArr);
+                "Only enough memory to allocate an average of %.1f arrivals per receiver",
+                (double)arrinfo->NArrBlocks * ArrBlockSize / (double)nSrcsRcvrs);
+        }
+        if(maxArrivals > 0) {
+            GetInternal(params)->PRTFile << "\n( Maximum # of arrivals = " << maxArrivals
+                                         << " )\n";
+        } else {
+            GetInternal(params)->PRTFile
+                << "\n( Maximum # of arrivals = "
+                << (int64_t)arrinfo->NArrBlocks * ArrBlockSize << " in total )\n";
         }
-        GetInternal(params)->PRTFile << "\n( Maximum # of arrivals = " << arrinfo->MaxNArr
-                                     << " )\n";
         trackallocate(
-            params, "arrivals", arrinfo->Arr, nSrcsRcvrs * (size_t)arrinfo->MaxNArr);
+            params, "arrivals", arrinfo->Arr,
+            (size_t)arrinfo->NArrBlocks * (size_t)ArrBlockSize);
+        trackallocate(params, "arrivals", arrinfo->ArrNext, arrinfo->NArrBlocks);
+        trackallocate(params, "arrivals", arrinfo->ArrHead, nSrcsRcvrs);
+        trackallocate(params, "arrivals", arrinfo->NArrBlocksUsed);
         trackallocate(params, "arrivals", arrinfo->NArr, nSrcsRcvrs);
         trackallocate(params, "arrivals", arrinfo->MaxNPerSource, nSrcs);
-        memset(arrinfo->Arr, 0, nSrcsRcvrs * (size_t)arrinfo->MaxNArr * sizeof(Arrival));
-        memset(arrinfo->NArr, 0, nSrcsRcvrs * sizeof(int32_t));
+        // The arena and ArrNext are initialized as blocks are used
+        *arrinfo->NArrBlocksUsed = 0;
+        GetInternal(params)->pool.FirstTouch(arrinfo->ArrHead, nSrcsRcvrs);
+        GetInternal(params)->pool.FirstTouch(arrinfo->NArr, nSrcsRcvrs);
         // MaxNPerSource does not have to be initialized
+        if(useHeaps) {
+            // Only receivers which hold K arrivals get a heap
+            arrinfo->NHeaps = (int32_t)std::min(
+                (int64_t)nSrcsRcvrs, (int64_t)arrinfo->NArrBlocks / blocksPerRcvr);
+            trackallocate(
+                params, "arrival heaps", arrinfo->Heap,
+                (size_t)arrinfo->NHeaps * (size_t)maxArrivals);
+            trackallocate(
+                params, "arrival heaps", arrinfo->HeapPos,
+                (size_t)arrinfo->NArrBlocks * (size_t)ArrBlockSize);
+            trackallocate(params, "arrival heaps", arrinfo->HeapHead, nSrcsRcvrs);
+            trackallocate(params, "arrival heaps", arrinfo->NHeapsUsed);
+            // Heap and HeapPos are initialized when a heap is built
+            *arrinfo->NHeapsUsed = 0;
+            GetInternal(params)->pool.FirstTouch(arrinfo->HeapHead, nSrcsRcvrs);
+        }
+        if(needLocks) {
+            trackallocate(params, "arrival locks", arrinfo->Locks, nSrcsRcvrs);
+            GetInternal(params)->pool.FirstTouch(arrinfo->Locks, nSrcsRcvrs);
+            trackallocate(
+                params, "arrival bookkeeping", arrinfo->LastArr, numThreads * nSrcsRcvrs);
+            GetInternal(params)->pool.FirstTouch(
+                arrinfo->LastArr, numThreads * nSrcsRcvrs);
+        }
     }
 
     virtual void Postprocess(
@@ -121,9 +214,24 @@ public:
     virtual void Finalize(
         bhcParams<O3D> &params, bhcOutputs<O3D, R3D> &outputs) const override
     {
-        trackdeallocate(params, outputs.arrinfo->Arr);
-        trackdeallocate(params, outputs.arrinfo->NArr);
-        trackdeallocate(params, outputs.arrinfo->MaxNPerSource);
+        FreeArrivals(params, outputs.arrinfo);
+    }
+
+private:
+    void FreeArrivals(bhcParams<O3D> &params, ArrInfo *arrinfo) const
+    {
+        trackdeallocate(params, arrinfo->Arr);
+        trackdeallocate(params, arrinfo->ArrHead);
+        trackdeallocate(params, arrinfo->ArrNext);
+        trackdeallocate(params, arrinfo->NArrBlocksUsed);
+        trackdeallocate(params, arrinfo->NArr);
+        trackdeallocate(params, arrinfo->MaxNPerSource);
+        trackdeallocate(params, arrinfo->Locks);
+        trackdeallocate(params, arrinfo->LastArr);
+        trackdeallocate(params, arrinfo->Heap);
+        trackdeallocate(params, arrinfo->HeapHead);
+        trackdeallocate(params, arrinfo->HeapPos);
+        trackdeallocate(params, arrinfo->NHeapsUsed);
     }
 };
 
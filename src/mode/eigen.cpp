@@ -17,49 +17,51 @@ You should have received a copy of the GNU General Public License along with
 this program. If not, see <https://www.gnu.org/licenses/>.
 */
 #include "eigen.hpp"
+#include "jobqueue.hpp"
 #include "../common_run.hpp"
 
 namespace bhc { namespace mode {
 
 template<bool O3D, bool R3D> void EigenModePostWorker(
-    const bhcParams<O3D> &params, bhcOutputs<O3D, R3D> &outputs, int32_t worker,
-    ErrState *errState)
+    const bhcParams<O3D> &params, bhcOutputs<O3D, R3D> &outputs, JobQueue &queue,
+    int32_t worker, ErrState *errState)
 {
-    SetupThread();
-    while(true) {
-        int32_t job = GetInternal(params)->sharedJobID++;
-        if(job >= bhc::min(outputs.eigen->neigen, outputs.eigen->memsize)) break;
-        EigenHit *hit  = &outputs.eigen->hits[job];
-        int32_t Nsteps = hit->is;
-        RayInitInfo rinit;
-        rinit.isx    = hit->isx;
-        rinit.isy    = hit->isy;
-        rinit.isz    = hit->isz;
-        rinit.ialpha = hit->ialpha;
-        rinit.ibeta  = hit->ibeta;
-        if(!RunRay<O3D, R3D>(
-               outputs.rayinfo, params, job, worker, rinit, Nsteps, errState)) {
-            // Already gave out of memory error; that is the only condition leading
-            // here printf("EigenModePostWorker RunRay failed\n");
-            break;
+    int32_t begin, end;
+    while(queue.GetChunk(worker, begin, end)) {
+        for(int32_t job = begin; job < end; ++job) {
+            if(queue.Cancelled()) return;
+            EigenHit *hit  = &outputs.eigen->hits[job];
+            int32_t Nsteps = hit->is;
+            RayInitInfo rinit;
+            rinit.isx    = hit->isx;
+            rinit.isy    = hit->isy;
+            rinit.isz    = hit->isz;
+            rinit.ialpha = hit->ialpha;
+            rinit.ibeta  = hit->ibeta;
+            if(!RunRay<O3D, R3D>(
+                   outputs.rayinfo, params, job, worker, rinit, Nsteps, errState)) {
+                // Already gave out of memory error; that is the only condition
+                // leading here printf("EigenModePostWorker RunRay failed\n");
+                return;
+            }
         }
     }
 }
 
 #if BHC_ENABLE_2D
 template void EigenModePostWorker<false, false>(
-    const bhcParams<false> &params, bhcOutputs<false, false> &outputs, int32_t worker,
-    ErrState *errState);
+    const bhcParams<false> &params, bhcOutputs<false, false> &outputs, JobQueue &queue,
+    int32_t worker, ErrState *errState);
 #endif
 #if BHC_ENABLE_NX2D
 template void EigenModePostWorker<true, false>(
-    const bhcParams<true> &params, bhcOutputs<true, false> &outputs, int32_t worker,
-    ErrState *errState);
+    const bhcParams<true> &params, bhcOutputs<true, false> &outputs, JobQueue &queue,
+    int32_t worker, ErrState *errState);
 #endif
 #if BHC_ENABLE_3D
 template void EigenModePostWorker<true, true>(
-    const bhcParams<true> &params, bhcOutputs<true, true> &outputs, int32_t worker,
-    ErrState *errState);
+    const bhcParams<true> &params, bhcOutputs<true, true> &outputs, JobQueue &queue,
+    int32_t worker, ErrState *errState);
 #endif
 
 template<bool O3D, bool R3D> void PostProcessEigenrays(
@@ -76,17 +78,15 @@ template<bool O3D, bool R3D> void PostProcessEigenrays(
         EXTWARN("%d eigenrays\n", (int)outputs.eigen->neigen);
     }
 
-    ErrState errState;
-    ResetErrState(&errState);
-    GetInternal(params)->sharedJobID = 0;
-    int32_t numThreads               = GetInternal(params)->numThreads;
-    std::vector<std::thread> threads;
-    for(int32_t i = 0; i < numThreads; ++i)
-        threads.push_back(std::thread(
-            EigenModePostWorker<O3D, R3D>, std::cref(params), std::ref(outputs), i,
-            &errState));
-    for(int32_t i = 0; i < numThreads; ++i) threads[i].join();
-    CheckReportErrors(GetInternal(params), &errState);
+    ErrShards errShards(GetInternal(params)->numThreads);
+    JobQueue queue(
+        GetInternal(params),
+        bhc::min(outputs.eigen->neigen, outputs.eigen->memsize));
+    GetInternal(params)->pool.Run([&](int32_t worker) {
+        EigenModePostWorker<O3D, R3D>(
+            params, outputs, queue, worker, errShards.Get(worker));
+    });
+    CheckReportErrors(GetInternal(params), errShards);
 
     raymode.Postprocess(params, outputs);
 }
@@ -21,8 +21,13 @@ this program. If not, see <https://www.gnu.org/licenses/>.
 
 namespace bhc { namespace mode {
 
+class JobQueue;
+template<bool O3D, bool R3D> class RayCache;
+
 template<typename CFG, bool O3D, bool R3D> void FieldModesWorker(
-    bhcParams<O3D> &params, bhcOutputs<O3D, R3D> &outputs, ErrState *errState);
+    bhcParams<O3D> &params, bhcOutputs<O3D, R3D> &outputs, JobQueue &queue,
+    int32_t worker, cpxf *uAllSources, bool exclusiveField,
+    const RayCache<O3D, R3D> &cache, ErrState *errState);
 
 template<typename CFG, bool O3D, bool R3D> void RunFieldModesImpl(
     bhcParams<O3D> &params, bhcOutputs<O3D, R3D> &outputs);
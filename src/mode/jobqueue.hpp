@@ -0,0 +1,218 @@
+/*
+bellhopcxx / bellhopcuda - C++/CUDA port of BELLHOP / BELLHOP3D underwater acoustics simulator
+Copyright (C) 2021-2023 The Regents of the University of California
+Marine Physical Lab at Scripps Oceanography, c/o Jules Jaffe, jjaffe@ucsd.edu
+Based on BELLHOP / BELLHOP3D, which is Copyright (C) 1983-2022 Michael B. Porter
+
+This program is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "../common.hpp"
+
+#include <algorithm>
+#include <vector>
+
+// #define JOBQUEUE_DEBUGGING 1
+
+namespace bhc { namespace mode {
+
+/**
+ * Rough relative cost of tracing a ray launched at elevation angle alpha
+ * (radians). Over a given range, a steep ray travels a longer path and bounces
+ * between the surface and the bottom many more times than a shallow one.
+ */
+inline real EstimateRayCost(real alpha)
+{
+    return RL(1.0) / bhc::max(STD::abs(STD::cos(alpha)), RL(0.01));
+}
+
+/**
+ * Distributes jobs to the workers with work stealing. Each worker owns a
+ * contiguous range of dispatch indices, which it consumes from the front in
+ * chunks, guided-scheduling style (each chunk is a fraction of what remains,
+ * shrinking to single jobs at the end). A worker whose range is empty steals
+ * the back half of the remaining range of another worker. There is no global
+ * counter in the hot path; sharedJobID only counts the completed jobs (for
+ * run_poll()), and is updated once per chunk.
+ *
+ * GetJob() converts a dispatch index to the job index as used by
+ * GetJobIndices().
+ *
+ * The queue can also hand out units of jobsPerUnit consecutive jobs, which are
+ * never split between workers. The chunks are then in units, and the worker
+ * processes dispatch indices [begin * jobsPerUnit, end * jobsPerUnit).
+ */
+class JobQueue {
+public:
+    JobQueue(bhcInternal *internal, int32_t numJobs_, int32_t jobsPerUnit_ = 1)
+        : completed(internal->sharedJobID), cancel(internal->cancelRun),
+          numJobs(numJobs_), jobsPerUnit(jobsPerUnit_), numThreads(internal->numThreads),
+          nAlpha(1), nOuter(numJobs_), ranges(internal->numThreads)
+    {
+        completed           = 0;
+        internal->totalJobs = numJobs;
+        int32_t numUnits = numJobs / jobsPerUnit;
+        for(int32_t w = 0; w < numThreads; ++w) {
+            ranges[w].begin = (int32_t)((int64_t)numUnits * w / numThreads);
+            ranges[w].end   = (int32_t)((int64_t)numUnits * (w + 1) / numThreads);
+        }
+    }
+
+    /**
+     * Reorder dispatch so that the rays which are expected to be the most
+     * expensive are started first, and split the initial ranges so that each
+     * worker gets about the same estimated cost.
+     *
+     * LP: Only done with multiple threads. Single-threaded runs process the
+     * rays in order, to match BELLHOP's order of arrivals / eigenrays and its
+     * order of summation of the field.
+     */
+    template<bool O3D> void OrderByCost(const Position *Pos, const AnglesStructure *Angles)
+    {
+        if(numThreads <= 1 || jobsPerUnit != 1) return;
+        if(Angles->alpha.iSingle != 0 || Angles->alpha.n <= 1) return;
+        if(GetNumJobs<O3D>(Pos, Angles) != numJobs) return;
+        nAlpha = Angles->alpha.n;
+        nOuter = numJobs / nAlpha;
+        alphaOrder.resize(nAlpha);
+        for(int32_t i = 0; i < nAlpha; ++i) alphaOrder[i] = i;
+        const real *angles = Angles->alpha.angles;
+        std::stable_sort(alphaOrder.begin(), alphaOrder.end(), [&](int32_t a, int32_t b) {
+            return EstimateRayCost(angles[a]) > EstimateRayCost(angles[b]);
+        });
+
+        // Each rank (block of nOuter dispatch indices) has a single cost
+        double total = 0.0;
+        for(int32_t r = 0; r < nAlpha; ++r) {
+            total += (double)EstimateRayCost(angles[alphaOrder[r]]) * (double)nOuter;
+        }
+        double perWorker = total / (double)numThreads;
+        double acc       = 0.0;
+        int32_t w        = 1;
+        for(int32_t r = 0; r < nAlpha && w < numThreads; ++r) {
+            double c = (double)EstimateRayCost(angles[alphaOrder[r]]);
+            while(w < numThreads && acc + c * (double)nOuter >= perWorker * (double)w) {
+                int32_t k = (int32_t)STD::ceil((perWorker * (double)w - acc) / c);
+                k         = bhc::min(bhc::max(k, 0), nOuter);
+                ranges[w - 1].end = ranges[w].begin = r * nOuter + k;
+                ++w;
+            }
+            acc += c * (double)nOuter;
+        }
+        for(; w < numThreads; ++w) ranges[w - 1].end = ranges[w].begin = numJobs;
+        ranges[numThreads - 1].end = numJobs;
+    }
+
+    /**
+     * Claims the next chunk of dispatch indices [begin, end) for this worker,
+     * stealing from other workers if necessary. Returns false if there are no
+     * more jobs.
+     */
+    inline bool GetChunk(int32_t worker, int32_t &begin, int32_t &end)
+    {
+        WorkerRange &own = ranges[worker];
+        // The previous chunk of this worker is done
+        if(own.pending > 0) {
+            completed.fetch_add(own.pending * jobsPerUnit, std::memory_order_relaxed);
+            own.pending = 0;
+        }
+        {
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if(own.begin < own.end) {
+                TakeChunk(own, begin, end);
+                return true;
+            }
+        }
+        for(int32_t i = 1; i < numThreads; ++i) {
+            WorkerRange &victim = ranges[(worker + i) % numThreads];
+            int32_t stolenBegin, stolenEnd;
+            {
+                std::lock_guard<std::mutex> lock(victim.mutex);
+                int32_t remaining = victim.end - victim.begin;
+                if(remaining <= 0) continue;
+                stolenEnd   = victim.end;
+                stolenBegin = victim.end - (remaining + 1) / 2;
+                victim.end  = stolenBegin;
+            }
+            std::lock_guard<std::mutex> lock(own.mutex);
+            ++own.steals;
+            own.begin = stolenBegin;
+            own.end   = stolenEnd;
+            TakeChunk(own, begin, end);
+            return true;
+        }
+        return false;
+    }
+
+    inline int32_t GetJob(int32_t d) const
+    {
+        if(alphaOrder.empty()) return d;
+        return (d % nOuter) * nAlpha + alphaOrder[d / nOuter];
+    }
+
+    /// Whether run_cancel() has been called; workers check this between rays.
+    inline bool Cancelled() const { return cancel.load(std::memory_order_relaxed); }
+
+    inline int32_t NumJobs() const { return numJobs; }
+    inline int32_t JobsPerUnit() const { return jobsPerUnit; }
+
+    /// Number of times this worker stole work from another worker.
+    inline int32_t Steals(int32_t worker) const { return ranges[worker].steals; }
+
+    /// For tuning: print the number of steals by each worker. Only with
+    /// JOBQUEUE_DEBUGGING, otherwise does nothing.
+    void PrintSteals([[maybe_unused]] bhcInternal *internal) const
+    {
+#ifdef JOBQUEUE_DEBUGGING
+        if(numThreads <= 1) return;
+        std::stringstream ss;
+        int32_t total = 0;
+        for(int32_t w = 0; w < numThreads; ++w) {
+            ss << " " << ranges[w].steals;
+            total += ranges[w].steals;
+        }
+        ExternalWarning(
+            internal, "Work stealing: %d steals, per worker:%s", total, ss.str().c_str());
+#endif
+    }
+
+private:
+    struct alignas(64) WorkerRange {
+        std::mutex mutex;
+        int32_t begin  = 0;
+        int32_t end    = 0;
+        int32_t steals = 0;
+        int32_t pending = 0; // units taken but not yet counted as completed
+    };
+
+    /// Each chunk is 1 / ChunkDivisor of the worker's remaining range.
+    static constexpr int32_t ChunkDivisor = 8;
+
+    inline void TakeChunk(WorkerRange &own, int32_t &begin, int32_t &end)
+    {
+        int32_t chunk = bhc::max((own.end - own.begin) / ChunkDivisor, 1);
+        begin         = own.begin;
+        end           = own.begin + chunk;
+        own.begin     = end;
+        own.pending   = chunk;
+    }
+
+    std::atomic<int32_t> &completed;
+    const std::atomic<bool> &cancel;
+    int32_t numJobs, jobsPerUnit, numThreads;
+    int32_t nAlpha, nOuter;
+    std::vector<int32_t> alphaOrder; // dispatch rank -> ialpha, empty if in order
+    std::vector<WorkerRange> ranges;
+};
+
+}} // namespace bhc::mode
@@ -0,0 +1,106 @@
+/*
+bellhopcxx / bellhopcuda - C++/CUDA port of BELLHOP / BELLHOP3D underwater acoustics simulator
+Copyright (C) 2021-2023 The Regents of the University of California
+Marine Physical Lab at Scripps Oceanography, c/o Jules Jaffe, jjaffe@ucsd.edu
+Based on BELLHOP / BELLHOP3D, which is Copyright (C) 1983-2022 Michael B. Porter
+
+This program is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "../common_setup.hpp"
+
+namespace bhc { namespace mode {
+
+/**
+ * Per-worker accumulation buffers for the TL field. Instead of every worker
+ * adding its contributions to the shared uAllSources with atomics, worker 0
+ * writes directly to uAllSources and each other worker writes to a private copy
+ * of the field, with plain stores. Afterwards, Reduce() sums the private
+ * copies into uAllSources in parallel.
+ *
+ * This needs numThreads-1 extra copies of the field. If they do not fit in the
+ * memory budget (maxMemory), no copies are made and the workers fall back to
+ * writing to uAllSources with atomics (Exclusive() returns false).
+ */
+template<bool O3D, bool R3D> class PrivateFields {
+public:
+    PrivateFields(
+        const bhcParams<O3D> &params_, bhcOutputs<O3D, R3D> &outputs, bool isTL)
+        : params(params_), uAllSources(outputs.uAllSources),
+          n(GetFieldSizeAllFreq(params_.Pos, params_.freqinfo)),
+          numThreads(GetInternal(params_)->numThreads), exclusive(false), copies(nullptr)
+    {
+        if(!isTL || uAllSources == nullptr) return;
+        if(numThreads <= 1) {
+            // Only one writer, nothing to allocate
+            exclusive = true;
+            return;
+        }
+        bhcInternal *internal = GetInternal(params);
+        uint64_t bytes        = (uint64_t)(numThreads - 1) * (uint64_t)n * sizeof(cpxf);
+        // Round up and add the size header, as in trackallocate
+        bytes = ((bytes + 15ull) & ~15ull) + 16ull;
+        if(internal->usedMemory + bytes > internal->maxMemory) return;
+        trackallocate(
+            params, "per-thread TL accumulation buffers", copies,
+            (size_t)(numThreads - 1) * n);
+        exclusive = true;
+    }
+    ~PrivateFields() { trackdeallocate(params, copies); }
+    PrivateFields(const PrivateFields &)            = delete;
+    PrivateFields &operator=(const PrivateFields &) = delete;
+
+    /// Whether each worker has its own field, so atomics are not needed.
+    inline bool Exclusive() const { return exclusive; }
+
+    /**
+     * The field this worker should write to. Must be called from the worker
+     * itself: the private buffer is zeroed here, so that its pages are first
+     * touched by the thread which uses them (see ThreadPool::FirstTouch).
+     */
+    inline cpxf *Get(int32_t worker)
+    {
+        if(copies == nullptr || worker == 0) return uAllSources;
+        cpxf *buf = copies + (size_t)(worker - 1) * n;
+        memset((void *)buf, 0, n * sizeof(cpxf));
+        return buf;
+    }
+
+    /**
+     * Sum all private buffers into uAllSources. The field is split into one
+     * contiguous slice per worker, and each worker sums all the buffers over
+     * its slice, so there are no conflicting writes.
+     */
+    void Reduce(ThreadPool &pool)
+    {
+        if(copies == nullptr) return;
+        pool.Run([this](int32_t worker) {
+            size_t begin = n * (size_t)worker / (size_t)numThreads;
+            size_t end   = n * (size_t)(worker + 1) / (size_t)numThreads;
+            for(int32_t c = 0; c < numThreads - 1; ++c) {
+                const cpxf *buf = copies + (size_t)c * n;
+                for(size_t i = begin; i < end; ++i) uAllSources[i] += buf[i];
+            }
+        });
+    }
+
+private:
+    const bhcParams<O3D> &params;
+    cpxf *uAllSources;
+    size_t n;
+    int32_t numThreads;
+    bool exclusive;
+    cpxf *copies;
+};
+
+}} // namespace bhc::mode
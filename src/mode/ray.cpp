@@ -17,6 +17,7 @@ You should have received a copy of the GNU General Public License along with
 this program. If not, see <https://www.gnu.org/licenses/>.
 */
 #include "ray.hpp"
+#include "jobqueue.hpp"
 #include "../trace.hpp"
 #include "../module/title.hpp"
 #include <vector>
@@ -43,42 +44,43 @@ template<bool O3D, bool R3D> bool RunRay(
 #endif
 
     Origin<O3D, R3D> org;
-    char st = params.ssp->Type;
+    const RunConstants *rc = &GetInternal(params)->runConsts;
+    char st                = params.ssp->Type;
     if(st == 'N') {
         MainRayMode<CfgSel<'R', 'G', 'N'>, O3D, R3D>(
             rinit, ray, Nsteps, rayinfo->MaxPointsPerRay, org, params.Bdry, params.bdinfo,
             params.refl, params.ssp, params.Pos, params.Angles, params.freqinfo,
-            params.Beam, params.sbp, errState);
+            params.Beam, rc, errState);
     } else if(st == 'C') {
         MainRayMode<CfgSel<'R', 'G', 'C'>, O3D, R3D>(
             rinit, ray, Nsteps, rayinfo->MaxPointsPerRay, org, params.Bdry, params.bdinfo,
             params.refl, params.ssp, params.Pos, params.Angles, params.freqinfo,
-            params.Beam, params.sbp, errState);
+            params.Beam, rc, errState);
     } else if(st == 'S') {
         MainRayMode<CfgSel<'R', 'G', 'S'>, O3D, R3D>(
             rinit, ray, Nsteps, rayinfo->MaxPointsPerRay, org, params.Bdry, params.bdinfo,
             params.refl, params.ssp, params.Pos, params.Angles, params.freqinfo,
-            params.Beam, params.sbp, errState);
+            params.Beam, rc, errState);
     } else if(st == 'P') {
         MainRayMode<CfgSel<'R', 'G', 'P'>, O3D, R3D>(
             rinit, ray, Nsteps, rayinfo->MaxPointsPerRay, org, params.Bdry, params.bdinfo,
             params.refl, params.ssp, params.Pos, params.Angles, params.freqinfo,
-            params.Beam, params.sbp, errState);
+            params.Beam, rc, errState);
     } else if(st == 'Q') {
         MainRayMode<CfgSel<'R', 'G', 'Q'>, O3D, R3D>(
             rinit, ray, Nsteps, rayinfo->MaxPointsPerRay, org, params.Bdry, params.bdinfo,
             params.refl, params.ssp, params.Pos, params.Angles, params.freqinfo,
-            params.Beam, params.sbp, errState);
+            params.Beam, rc, errState);
     } else if(st == 'H') {
         MainRayMode<CfgSel<'R', 'G', 'H'>, O3D, R3D>(
             rinit, ray, Nsteps, rayinfo->MaxPointsPerRay, org, params.Bdry, params.bdinfo,
             params.refl, params.ssp, params.Pos, params.Angles, params.freqinfo,
-            params.Beam, params.sbp, errState);
+            params.Beam, rc, errState);
     } else if(st == 'A') {
         MainRayMode<CfgSel<'R', 'G', 'A'>, O3D, R3D>(
             rinit, ray, Nsteps, rayinfo->MaxPointsPerRay, org, params.Bdry, params.bdinfo,
             params.refl, params.ssp, params.Pos, params.Angles, params.freqinfo,
-            params.Beam, params.sbp, errState);
+            params.Beam, rc, errState);
     } else {
         RunError(errState, BHC_ERR_INVALID_SSP_TYPE);
         return false;
@@ -123,51 +125,52 @@ template bool RunRay<true, true>(
 #endif
 
 template<bool O3D, bool R3D> void RayModeWorker(
-    const bhcParams<O3D> &params, bhcOutputs<O3D, R3D> &outputs, int32_t worker,
-    ErrState *errState)
+    const bhcParams<O3D> &params, bhcOutputs<O3D, R3D> &outputs, JobQueue &queue,
+    int32_t worker, ErrState *errState)
 {
-    SetupThread();
-    while(true) {
-        int32_t job    = GetInternal(params)->sharedJobID++;
-        int32_t Nsteps = -1;
-        RayInitInfo rinit;
-        if(!GetJobIndices<O3D>(rinit, job, params.Pos, params.Angles)) break;
-        if(!RunRay<O3D, R3D>(
-               outputs.rayinfo, params, job, worker, rinit, Nsteps, errState)) {
-            break;
+    int32_t begin, end;
+    while(queue.GetChunk(worker, begin, end)) {
+        for(int32_t d = begin; d < end; ++d) {
+            if(queue.Cancelled()) return;
+            int32_t job    = queue.GetJob(d);
+            int32_t Nsteps = -1;
+            RayInitInfo rinit;
+            if(!GetJobIndices<O3D>(rinit, job, params.Pos, params.Angles)) return;
+            if(!RunRay<O3D, R3D>(
+                   outputs.rayinfo, params, job, worker, rinit, Nsteps, errState)) {
+                return;
+            }
         }
     }
 }
 
 #if BHC_ENABLE_2D
 template void RayModeWorker<false, false>(
-    const bhcParams<false> &params, bhcOutputs<false, false> &outputs, int32_t worker,
-    ErrState *errState);
+    const bhcParams<false> &params, bhcOutputs<false, false> &outputs, JobQueue &queue,
+    int32_t worker, ErrState *errState);
 #endif
 #if BHC_ENABLE_NX2D
 template void RayModeWorker<true, false>(
-    const bhcParams<true> &params, bhcOutputs<true, false> &outputs, int32_t worker,
-    ErrState *errState);
+    const bhcParams<true> &params, bhcOutputs<true, false> &outputs, JobQueue &queue,
+    int32_t worker, ErrState *errState);
 #endif
 #if BHC_ENABLE_3D
 template void RayModeWorker<true, true>(
-    const bhcParams<true> &params, bhcOutputs<true, true> &outputs, int32_t worker,
-    ErrState *errState);
+    const bhcParams<true> &params, bhcOutputs<true, true> &outputs, JobQueue &queue,
+    int32_t worker, ErrState *errState);
 #endif
 
 template<bool O3D, bool R3D> void RunRayMode(
     bhcParams<O3D> &params, bhcOutputs<O3D, R3D> &outputs)
 {
-    ErrState errState;
-    ResetErrState(&errState);
-    GetInternal(params)->sharedJobID = 0;
-    int32_t numThreads               = GetInternal(params)->numThreads;
-    std::vector<std::thread> threads;
-    for(int32_t i = 0; i < numThreads; ++i)
-        threads.push_back(std::thread(
-            RayModeWorker<O3D, R3D>, std::ref(params), std::ref(outputs), i, &errState));
-    for(int32_t i = 0; i < numThreads; ++i) threads[i].join();
-    CheckReportErrors(GetInternal(params), &errState);
+    ErrShards errShards(GetInternal(params)->numThreads);
+    JobQueue queue(GetInternal(params), GetNumJobs<O3D>(params.Pos, params.Angles));
+    queue.OrderByCost<O3D>(params.Pos, params.Angles);
+    GetInternal(params)->pool.Run([&](int32_t worker) {
+        RayModeWorker<O3D, R3D>(params, outputs, queue, worker, errShards.Get(worker));
+    });
+    queue.PrintSteals(GetInternal(params));
+    CheckReportErrors(GetInternal(params), errShards);
 }
 
 #if BHC_ENABLE_2D
@@ -333,16 +336,15 @@ template<bool O3D, bool R3D> void ReadOutRay(
         rayinfo->results[NRays].ray[Nsteps - 1].NumTopBnc = NumTopBnc;
         rayinfo->results[NRays].ray[Nsteps - 1].NumBotBnc = NumBotBnc;
 
-        ErrState errState;
-        ResetErrState(&errState);
+        ErrShards errShards(1);
         for(int32_t is = 0; is < Nsteps; ++is) {
             VEC23<O3D> v;
             LIST(RAYFile);
             RAYFile.Read(v);
             rayinfo->results[NRays].ray[is].x
-                = OceanToRayX(v, rayinfo->results[NRays].org, t, -1, &errState);
+                = OceanToRayX(v, rayinfo->results[NRays].org, t, -1, errShards.Get(0));
         }
-        CheckReportErrors(GetInternal(params), &errState);
+        CheckReportErrors(GetInternal(params), errShards);
 
         TotalPoints += (size_t)Nsteps;
         ++NRays;
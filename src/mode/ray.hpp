@@ -75,6 +75,8 @@ public:
     {
         RayInfo<O3D, R3D> *rayinfo = outputs.rayinfo;
 
+        // Overwrites any rays kept by bhcInit::rayCache
+        GetInternal(params)->rayCacheKey.clear();
         trackdeallocate(params, rayinfo->RayMem);
         trackdeallocate(params, rayinfo->WorkRayMem);
         rayinfo->NRays = IsEigenraysRun(params.Beam)
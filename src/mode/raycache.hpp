@@ -0,0 +1,215 @@
+/*
+bellhopcxx / bellhopcuda - C++/CUDA port of BELLHOP / BELLHOP3D underwater acoustics simulator
+Copyright (C) 2021-2023 The Regents of the University of California
+Marine Physical Lab at Scripps Oceanography, c/o Jules Jaffe, jjaffe@ucsd.edu
+Based on BELLHOP / BELLHOP3D, which is Copyright (C) 1983-2022 Michael B. Porter
+
+This program is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "../common_setup.hpp"
+#include "../common_run.hpp"
+
+#include <string>
+
+namespace bhc { namespace mode {
+
+template<typename T> inline void AppendRayCacheKey(
+    std::string &key, const T *v, size_t n = 1)
+{
+    key.append(reinterpret_cast<const char *>(v), n * sizeof(T));
+}
+
+inline void AppendRayCacheKeyHS(std::string &key, const HSInfo &hs)
+{
+    AppendRayCacheKey(key, &hs.cP);
+    AppendRayCacheKey(key, &hs.cS);
+    AppendRayCacheKey(key, &hs.rho);
+    AppendRayCacheKey(key, &hs.Depth);
+    AppendRayCacheKey(key, &hs.bc);
+    AppendRayCacheKey(key, hs.Opt, 6);
+}
+
+/**
+ * Everything the ray paths depend on, other than the SSP and the boundaries,
+ * whose changes are detected with their dirty flags. Must be called after
+ * preprocessing, so that all values are in the same units every run.
+ */
+template<bool O3D> inline std::string RayCacheKey(const bhcParams<O3D> &params)
+{
+    std::string key;
+    const Position *Pos            = params.Pos;
+    const AnglesStructure *Angles  = params.Angles;
+    const BeamStructure<O3D> *Beam = params.Beam;
+    const ReflectionInfo *refl     = params.refl;
+    // Beam shift / curvature options, and the options which change the
+    // initial values along the ray
+    const char traceOpts[5] = {
+        params.ssp->Type, Beam->Type[2], Beam->Type[3], (char)(Beam->RunType[1] == 'G'),
+        (char)IsSemiCoherentRun(Beam)};
+    AppendRayCacheKey(key, traceOpts, 5);
+    AppendRayCacheKey(key, &Pos->NSx);
+    AppendRayCacheKey(key, &Pos->NSy);
+    AppendRayCacheKey(key, &Pos->NSz);
+    AppendRayCacheKey(key, Pos->Sx, Pos->NSx);
+    AppendRayCacheKey(key, Pos->Sy, Pos->NSy);
+    AppendRayCacheKey(key, Pos->Sz, Pos->NSz);
+    for(const AngleInfo *a : {&Angles->alpha, &Angles->beta}) {
+        AppendRayCacheKey(key, &a->n);
+        AppendRayCacheKey(key, &a->iSingle);
+        AppendRayCacheKey(key, a->angles, a->n);
+    }
+    AppendRayCacheKey(key, &params.freqinfo->freq0);
+    AppendRayCacheKey(key, &Beam->deltas);
+    AppendRayCacheKey(key, &Beam->stepTol);
+    AppendRayCacheKey(key, &Beam->deltasMin);
+    AppendRayCacheKey(key, &Beam->deltasMax);
+    AppendRayCacheKey(key, &Beam->Box);
+    AppendRayCacheKeyHS(key, params.Bdry->Top.hs);
+    AppendRayCacheKeyHS(key, params.Bdry->Bot.hs);
+    for(const ReflectionInfoTopBot *rtb : {&refl->bot, &refl->top}) {
+        AppendRayCacheKey(key, &rtb->NPts);
+        AppendRayCacheKey(key, rtb->r, rtb->NPts);
+    }
+    AppendRayCacheKey(key, &params.sbp->NSBPPts);
+    AppendRayCacheKey(key, params.sbp->SrcBmPat, 2 * params.sbp->NSBPPts);
+    return key;
+}
+
+/**
+ * Trace-once mode for TL and arrivals runs (bhcInit::rayCache). The rays are
+ * kept in outputs.rayinfo, as in ray copy mode: each worker traces into its
+ * own buffer of MaxN points, applies the influence from there, and then copies
+ * the points of the ray into a shared arena. After the run, the arena is
+ * shrunk to the rays' actual size. If the rays of the previous run are still
+ * valid for this run, the workers Replay() them instead of tracing.
+ *
+ * canUse is false for runs which cannot use the cache (Cerveny beams,
+ * eigenrays, streaming TL); these leave the kept rays alone.
+ */
+template<bool O3D, bool R3D> class RayCache {
+public:
+    RayCache(const bhcParams<O3D> &params_, bhcOutputs<O3D, R3D> &outputs, bool canUse)
+        : params(params_), rayinfo(outputs.rayinfo), replay(false), record(false)
+    {
+        bhcInternal *internal = GetInternal(params);
+        if(!internal->rayCache || !canUse) return;
+        key = RayCacheKey<O3D>(params);
+        if(key == internal->rayCacheKey) {
+            replay = true;
+            return;
+        }
+
+        // Drop the old rays before budgeting memory for the new ones
+        internal->rayCacheKey.clear();
+        trackdeallocate(params, rayinfo->RayMem);
+        trackdeallocate(params, rayinfo->WorkRayMem);
+        trackdeallocate(params, rayinfo->results);
+        rayinfo->NRays           = GetNumJobs<O3D>(params.Pos, params.Angles);
+        rayinfo->MaxPointsPerRay = MaxN;
+        rayinfo->isCopyMode      = true;
+        rayinfo->RayMemCapacity  = 0;
+        rayinfo->RayMemPoints    = 0;
+        size_t fixedBytes = (size_t)rayinfo->NRays * sizeof(RayResult<O3D, R3D>)
+            + (size_t)internal->numThreads * MaxN * sizeof(rayPt<R3D>);
+        // Half of the rest, so that Finish() can copy the rays to an array of
+        // their actual size
+        size_t capacity = internal->usedMemory + fixedBytes < internal->maxMemory
+            ? (internal->maxMemory - internal->usedMemory - fixedBytes) / 2
+                / sizeof(rayPt<R3D>)
+            : 0;
+        if(capacity < (size_t)MaxN) {
+            EXTWARN("Not enough memory for the ray cache, rays will not be kept");
+            return;
+        }
+        trackallocate(params, "ray cache metadata", rayinfo->results, rayinfo->NRays);
+        memset(rayinfo->results, 0, rayinfo->NRays * sizeof(RayResult<O3D, R3D>));
+        trackallocate(
+            params, "ray cache work rays", rayinfo->WorkRayMem,
+            internal->numThreads * MaxN);
+        trackallocate(params, "ray cache", rayinfo->RayMem, capacity);
+        rayinfo->RayMemCapacity = capacity;
+        record                  = true;
+    }
+    RayCache(const RayCache &)            = delete;
+    RayCache &operator=(const RayCache &) = delete;
+
+    /// Whether the workers apply the influence of the kept rays, without tracing.
+    inline bool Replay() const { return replay; }
+    /// Whether the workers trace into WorkRay() and Store() the rays.
+    inline bool Record() const { return record; }
+
+    inline rayPt<R3D> *WorkRay(int32_t worker) const
+    {
+        return &rayinfo->WorkRayMem[(size_t)worker * MaxN];
+    }
+    inline RayResult<O3D, R3D> &Result(int32_t job) const
+    {
+        return rayinfo->results[job];
+    }
+
+    /**
+     * Copies the ray in res from the work buffer to the arena. If the arena is
+     * full, the ray is dropped, and Finish() discards the cache.
+     */
+    inline void Store(RayResult<O3D, R3D> &res) const
+    {
+        size_t p = AtomicFetchAdd(&rayinfo->RayMemPoints, (size_t)res.Nsteps);
+        if(p + (size_t)res.Nsteps > rayinfo->RayMemCapacity) {
+            res.ray = nullptr;
+            return;
+        }
+        memcpy(&rayinfo->RayMem[p], res.ray, res.Nsteps * sizeof(rayPt<R3D>));
+        res.ray = &rayinfo->RayMem[p];
+    }
+
+    /**
+     * After the run: keeps the recorded rays, in an array of their actual
+     * size, unless some did not fit or the run did not complete.
+     */
+    void Finish(bool complete)
+    {
+        if(!record) return;
+        bhcInternal *internal = GetInternal(params);
+        trackdeallocate(params, rayinfo->WorkRayMem);
+        if(rayinfo->RayMemPoints > rayinfo->RayMemCapacity) {
+            EXTWARN("Not enough memory for the ray cache, rays will not be kept");
+            complete = false;
+        }
+        if(!complete) {
+            trackdeallocate(params, rayinfo->RayMem);
+            trackdeallocate(params, rayinfo->results);
+            rayinfo->NRays = 0;
+            return;
+        }
+        rayPt<R3D> *rays = nullptr;
+        trackallocate(params, "ray cache", rays, rayinfo->RayMemPoints);
+        memcpy(rays, rayinfo->RayMem, rayinfo->RayMemPoints * sizeof(rayPt<R3D>));
+        for(int32_t r = 0; r < rayinfo->NRays; ++r) {
+            RayResult<O3D, R3D> &res = rayinfo->results[r];
+            if(res.ray != nullptr) res.ray = rays + (res.ray - rayinfo->RayMem);
+        }
+        trackdeallocate(params, rayinfo->RayMem);
+        rayinfo->RayMem         = rays;
+        rayinfo->RayMemCapacity = rayinfo->RayMemPoints;
+        internal->rayCacheKey   = key;
+    }
+
+private:
+    const bhcParams<O3D> &params;
+    RayInfo<O3D, R3D> *rayinfo;
+    std::string key;
+    bool replay, record;
+};
+
+}} // namespace bhc::mode
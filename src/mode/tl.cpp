@@ -106,8 +106,15 @@ template<bool O3D> inline void WriteHeader(
 template<bool O3D, bool R3D> void PostProcessTL(
     const bhcParams<O3D> &params, bhcOutputs<O3D, R3D> &outputs)
 {
-    ErrState errState;
-    ResetErrState(&errState);
+    // Per source: the sound speed and beam epsilons at the source
+    struct SourceScale {
+        real c;
+        cpx epsilon1, epsilon2;
+    };
+    std::vector<SourceScale> scales(
+        (size_t)params.Pos->NSz * params.Pos->NSx * params.Pos->NSy);
+    ErrShards errShards(1);
+    ErrState *errState = errShards.Get(0);
     for(int32_t isz = 0; isz < params.Pos->NSz; ++isz) {
         for(int32_t isx = 0; isx < params.Pos->NSx; ++isx) {
             for(int32_t isy = 0; isy < params.Pos->NSy; ++isy) {
@@ -118,31 +125,31 @@ template<bool O3D, bool R3D> void PostProcessTL(
                 char st = params.ssp->Type;
                 if(st == 'N') {
                     o = RayStartNominalSSP<CfgSel<'C', 'G', 'N'>, O3D>(
-                        isx, isy, isz, FL(0.0), iSeg, params.Pos, params.ssp, &errState,
+                        isx, isy, isz, FL(0.0), iSeg, params.Pos, params.ssp, errState,
                         xs, tinit);
                 } else if(st == 'C') {
                     o = RayStartNominalSSP<CfgSel<'C', 'G', 'C'>, O3D>(
-                        isx, isy, isz, FL(0.0), iSeg, params.Pos, params.ssp, &errState,
+                        isx, isy, isz, FL(0.0), iSeg, params.Pos, params.ssp, errState,
                         xs, tinit);
                 } else if(st == 'S') {
                     o = RayStartNominalSSP<CfgSel<'C', 'G', 'S'>, O3D>(
-                        isx, isy, isz, FL(0.0), iSeg, params.Pos, params.ssp, &errState,
+                        isx, isy, isz, FL(0.0), iSeg, params.Pos, params.ssp, errState,
                         xs, tinit);
                 } else if(st == 'P') {
                     o = RayStartNominalSSP<CfgSel<'C', 'G', 'P'>, O3D>(
-                        isx, isy, isz, FL(0.0), iSeg, params.Pos, params.ssp, &errState,
+                        isx, isy, isz, FL(0.0), iSeg, params.Pos, params.ssp, errState,
                         xs, tinit);
                 } else if(st == 'Q') {
                     o = RayStartNominalSSP<CfgSel<'C', 'G', 'Q'>, O3D>(
-                        isx, isy, isz, FL(0.0), iSeg, params.Pos, params.ssp, &errState,
+                        isx, isy, isz, FL(0.0), iSeg, params.Pos, params.ssp, errState,
                         xs, tinit);
                 } else if(st == 'H') {
                     o = RayStartNominalSSP<CfgSel<'C', 'G', 'H'>, O3D>(
-                        isx, isy, isz, FL(0.0), iSeg, params.Pos, params.ssp, &errState,
+                        isx, isy, isz, FL(0.0), iSeg, params.Pos, params.ssp, errState,
                         xs, tinit);
                 } else if(st == 'A') {
                     o = RayStartNominalSSP<CfgSel<'C', 'G', 'A'>, O3D>(
-                        isx, isy, isz, FL(0.0), iSeg, params.Pos, params.ssp, &errState,
+                        isx, isy, isz, FL(0.0), iSeg, params.Pos, params.ssp, errState,
                         xs, tinit);
                 } else {
                     EXTERR("Invalid ssp->Type %c!", st);
@@ -153,30 +160,46 @@ template<bool O3D, bool R3D> void PostProcessTL(
                     // are only used in ScalePressure for 3D
                     epsilon1 = PickEpsilon<O3D, R3D>(
                         FL(2.0) * REAL_PI * params.freqinfo->freq0, o.ccpx.real(),
-                        o.gradc, FL(0.0), params.Angles->alpha.d, params.Beam, &errState);
+                        o.gradc, FL(0.0), params.Angles->alpha.d, params.Beam, errState);
                     epsilon2 = PickEpsilon<O3D, R3D>(
                         FL(2.0) * REAL_PI * params.freqinfo->freq0, o.ccpx.real(),
-                        o.gradc, FL(0.0), params.Angles->beta.d, params.Beam, &errState);
+                        o.gradc, FL(0.0), params.Angles->beta.d, params.Beam, errState);
                 } else {
                     epsilon1 = epsilon2 = RL(0.0);
                 }
-                if(HasErrored(&errState)) {
+                if(HasErrored(errState)) {
                     // Exit loops
                     isx = params.Pos->NSx;
                     isz = params.Pos->NSz;
                     break;
                 }
-                ScalePressure<O3D, R3D>(
-                    params.Angles->alpha.d, params.Angles->beta.d, o.ccpx.real(),
-                    epsilon1, epsilon2, params.Pos->Rr,
-                    &outputs
-                         .uAllSources[GetFieldAddr(isx, isy, isz, 0, 0, 0, params.Pos)],
-                    params.Pos->Ntheta, params.Pos->NRz_per_range, params.Pos->NRr,
-                    params.freqinfo->freq0, params.Beam);
+                SourceScale &scale
+                    = scales[(isz * params.Pos->NSx + isx) * params.Pos->NSy + isy];
+                scale.c        = o.ccpx.real();
+                scale.epsilon1 = epsilon1;
+                scale.epsilon2 = epsilon2;
             }
         }
     }
-    CheckReportErrors(GetInternal(params), &errState);
+    CheckReportErrors(GetInternal(params), errShards);
+
+    // LP: The scaling is the same for all receivers of a source, so it is done
+    // in parallel over rows of receivers (all ranges at one depth and bearing).
+    // For broadband TL, it is also the same for all frequencies (broadband
+    // requires geometric beams, whose scaling does not depend on frequency).
+    size_t rowsPerSource = (size_t)params.Pos->Ntheta * params.Pos->NRz_per_range;
+    GetInternal(params)->pool.ForSlices(
+        scales.size() * rowsPerSource * params.freqinfo->NFieldFreq,
+        [&](size_t rowBegin, size_t rowEnd) {
+            for(size_t row = rowBegin; row < rowEnd; ++row) {
+                const SourceScale &scale = scales[row / rowsPerSource % scales.size()];
+                ScalePressure<O3D, R3D>(
+                    params.Angles->alpha.d, params.Angles->beta.d, scale.c,
+                    scale.epsilon1, scale.epsilon2, params.Pos->Rr,
+                    &outputs.uAllSources[row * (size_t)params.Pos->NRr], 1, 1,
+                    params.Pos->NRr, params.freqinfo->freq0, params.Beam);
+            }
+        });
 }
 
 #if BHC_ENABLE_2D
@@ -192,17 +215,45 @@ template void PostProcessTL<true, true>(
     const bhcParams<true> &params, bhcOutputs<true, true> &outputs);
 #endif
 
-template<bool O3D> inline size_t GetRecNum(
-    const bhcParams<O3D> &params, int32_t isx, int32_t isy, int32_t itheta, int32_t isz,
-    int32_t Irz1)
+/**
+ * Write the SHD records of a box of sources. u is the field for the sources in
+ * srcPos (see RunStreamingTL), which are the sources starting at isz0, isx0,
+ * isy0 in params.Pos. For broadband TL, u holds the field of each frequency in
+ * turn.
+ */
+template<bool O3D> void WriteTLRecords(
+    const bhcParams<O3D> &params, DirectOFile &SHDFile, const cpxf *u,
+    const Position *srcPos, int32_t isz0, int32_t isx0, int32_t isy0)
 {
     // clang-format off
-    return        10                     + ((((size_t)isx
-        * (size_t)params.Pos->NSy           + (size_t)isy)
-        * (size_t)params.Pos->Ntheta        + (size_t)itheta)
-        * (size_t)params.Pos->NSz           + (size_t)isz)
-        * (size_t)params.Pos->NRz_per_range + (size_t)Irz1;
+    // LP: There are three different orders of the data used here.
+    // Field: (largest) Z, X, Y, theta, depth, radius (smallest)
+    // File:  (largest) X, Y, theta, Z, depth, radius (smallest)
+    // Write: (largest) Z, X, Y, depth, theta, radius (smallest)
+    // (XYZ are source; theta depth radius are receiver)
     // clang-format on
+    // Since the write order doesn't change the file contents, the write order
+    // has been changed to match the file order, to hopefully speed up I/O.
+    // The depths of one source and bearing are consecutive in both the field
+    // and the file, so they are written as one block of records.
+    for(int32_t ifreq = 0; ifreq < params.freqinfo->NFieldFreq; ++ifreq) {
+        const cpxf *uf = u + (size_t)ifreq * GetFieldSize(srcPos);
+        for(int32_t isx = 0; isx < srcPos->NSx; ++isx) {
+            for(int32_t isy = 0; isy < srcPos->NSy; ++isy) {
+                for(int32_t itheta = 0; itheta < srcPos->Ntheta; ++itheta) {
+                    for(int32_t isz = 0; isz < srcPos->NSz; ++isz) {
+                        DOFWRITERECS(
+                            SHDFile,
+                            GetRecNum(
+                                params.Pos, isx0 + isx, isy0 + isy, itheta, isz0 + isz,
+                                0, ifreq),
+                            &uf[GetFieldAddr(isx, isy, isz, itheta, 0, 0, srcPos)],
+                            srcPos->NRz_per_range, srcPos->NRr * sizeof(cpxf));
+                    }
+                }
+            }
+        }
+    }
 }
 
 /**
@@ -219,32 +270,7 @@ template<bool O3D, bool R3D> void WriteOutTL(
     // input (LP: not anymore)
     PlotType = IsIrregularGrid(params.Beam) ? "irregular " : "rectilin  ";
     WriteHeader(params, SHDFile, atten, PlotType);
-
-    // clang-format off
-    // LP: There are three different orders of the data used here.
-    // Field: (largest) Z, X, Y, theta, depth, radius (smallest)
-    // File:  (largest) X, Y, theta, Z, depth, radius (smallest)
-    // Write: (largest) Z, X, Y, depth, theta, radius (smallest)
-    // (XYZ are source; theta depth radius are receiver)
-    // clang-format on
-    // Since the write order doesn't change the file contents, the write order
-    // has been changed to match the file order, to hopefully speed up I/O.
-    for(int32_t isx = 0; isx < params.Pos->NSx; ++isx) {
-        for(int32_t isy = 0; isy < params.Pos->NSy; ++isy) {
-            for(int32_t itheta = 0; itheta < params.Pos->Ntheta; ++itheta) {
-                for(int32_t isz = 0; isz < params.Pos->NSz; ++isz) {
-                    for(int32_t Irz1 = 0; Irz1 < params.Pos->NRz_per_range; ++Irz1) {
-                        SHDFile.rec(GetRecNum(params, isx, isy, itheta, isz, Irz1));
-                        for(int32_t r = 0; r < params.Pos->NRr; ++r) {
-                            cpxf v = outputs.uAllSources[GetFieldAddr(
-                                isx, isy, isz, itheta, Irz1, r, params.Pos)];
-                            DOFWRITEV(SHDFile, v);
-                        }
-                    }
-                }
-            }
-        }
-    }
+    WriteTLRecords(params, SHDFile, outputs.uAllSources, params.Pos, 0, 0, 0);
 }
 
 #if BHC_ENABLE_2D
@@ -260,14 +286,94 @@ template void WriteOutTL<true, true>(
     const bhcParams<true> &params, const bhcOutputs<true, true> &outputs);
 #endif
 
-template<bool O3D, bool R3D> void ReadOutTL(
-    bhcParams<O3D> &params, bhcOutputs<O3D, R3D> &outputs, const char *FileRoot)
+/**
+ * TL run in batches of sources (bhcInit::streamTL). Each batch is a box of
+ * sources which is contiguous in the field: a range of source depths (with all
+ * x and y), or a range of x (one depth), or a range of y (one depth and x).
+ * During a batch, params.Pos is replaced by a copy which only has the sources
+ * of the batch, so the ray tracing and post-processing run unchanged on the
+ * field buffer of the batch. Then the batch is written to the SHD file and the
+ * buffer reused for the next batch.
+ */
+template<bool O3D, bool R3D> void RunStreamingTL(
+    bhcParams<O3D> &params, bhcOutputs<O3D, R3D> &outputs)
+{
+    bhcInternal *internal = GetInternal(params);
+    Position *Pos         = params.Pos;
+    int32_t maxSources    = internal->streamSources;
+
+    // Batch size in each source dimension
+    int32_t cy = bhc::min(maxSources, Pos->NSy);
+    int32_t cx = cy == Pos->NSy ? bhc::min(maxSources / Pos->NSy, Pos->NSx) : 1;
+    int32_t cz = cx == Pos->NSx && cy == Pos->NSy
+        ? bhc::min(maxSources / (Pos->NSx * Pos->NSy), Pos->NSz)
+        : 1;
+
+    DirectOFile SHDFile(internal);
+    std::string PlotType = IsIrregularGrid(params.Beam) ? "irregular " : "rectilin  ";
+    WriteHeader(params, SHDFile, FL(0.0), PlotType);
+
+    // LP: Allocated rather than on the stack, so it is also accessible on the GPU.
+    Position *srcPos = nullptr;
+    trackallocate(params, "source batch", srcPos, 1);
+    *srcPos = *Pos;
+    try {
+        for(int32_t isz0 = 0; isz0 < Pos->NSz; isz0 += cz) {
+            for(int32_t isx0 = 0; isx0 < Pos->NSx; isx0 += cx) {
+                for(int32_t isy0 = 0; isy0 < Pos->NSy; isy0 += cy) {
+                    srcPos->NSz = bhc::min(cz, Pos->NSz - isz0);
+                    srcPos->NSx = bhc::min(cx, Pos->NSx - isx0);
+                    srcPos->NSy = bhc::min(cy, Pos->NSy - isy0);
+                    srcPos->Sz  = Pos->Sz + isz0;
+                    srcPos->Sx  = Pos->Sx + isx0;
+                    srcPos->Sy  = Pos->Sy + isy0;
+                    internal->pool.FirstTouch(
+                        outputs.uAllSources,
+                        GetFieldSizeAllFreq(srcPos, params.freqinfo));
+
+                    params.Pos = srcPos;
+                    RunFieldModesSelInfl<O3D, R3D>(params, outputs);
+                    PostProcessTL<O3D, R3D>(params, outputs);
+                    params.Pos = Pos;
+                    if(internal->cancelRun.load(std::memory_order_relaxed)) {
+                        EXTERR("Run cancelled");
+                    }
+
+                    WriteTLRecords(
+                        params, SHDFile, outputs.uAllSources, srcPos, isz0, isx0, isy0);
+                }
+            }
+        }
+    } catch(...) {
+        params.Pos = Pos;
+        trackdeallocate(params, srcPos);
+        throw;
+    }
+    trackdeallocate(params, srcPos);
+}
+
+#if BHC_ENABLE_2D
+template void RunStreamingTL<false, false>(
+    bhcParams<false> &params, bhcOutputs<false, false> &outputs);
+#endif
+#if BHC_ENABLE_NX2D
+template void RunStreamingTL<true, false>(
+    bhcParams<true> &params, bhcOutputs<true, false> &outputs);
+#endif
+#if BHC_ENABLE_3D
+template void RunStreamingTL<true, true>(
+    bhcParams<true> &params, bhcOutputs<true, true> &outputs);
+#endif
+
+/**
+ * Reads the header records of an SHD file into params (title, frequencies,
+ * source and receiver positions), and sets NRz_per_range.
+ */
+template<bool O3D> void ReadSHDHeader(bhcParams<O3D> &params, DirectIFile &SHDFile)
 {
     Position *Pos      = params.Pos;
     FreqInfo *freqinfo = params.freqinfo;
 
-    DirectIFile SHDFile(GetInternal(params));
-    SHDFile.open(std::string(FileRoot) + ".shd");
     DIFREC(SHDFile, 0);
     DIFSKIP(SHDFile, 4);
     std::string TempTitle = DIFREADS(SHDFile, 80);
@@ -296,7 +402,10 @@ template<bool O3D, bool R3D> void ReadOutTL(
     float atten;
     DIFREADV(SHDFile, atten);
 
-    if(freqinfo->Nfreq != 1) { EXTERR("Nfreq in SHDFile being loaded is not 1"); }
+    if(freqinfo->Nfreq != 1 && !GetInternal(params)->broadbandTL) {
+        EXTERR("Nfreq in SHDFile being loaded is not 1 (load it with broadbandTL)");
+    }
+    freqinfo->NFieldFreq = freqinfo->Nfreq;
     if constexpr(!O3D) {
         if(Pos->Ntheta != 1 || Pos->NSx != 1 || Pos->NSy != 1) {
             EXTERR(
@@ -339,22 +448,31 @@ template<bool O3D, bool R3D> void ReadOutTL(
 
     module::SzRz<O3D> szrz;
     szrz.Preprocess(params); // sets NRz_per_range
+}
+
+template<bool O3D, bool R3D> void ReadOutTL(
+    bhcParams<O3D> &params, bhcOutputs<O3D, R3D> &outputs, const char *FileRoot)
+{
+    Position *Pos = params.Pos;
+
+    DirectIFile SHDFile(GetInternal(params));
+    SHDFile.open(std::string(FileRoot) + ".shd");
+    ReadSHDHeader(params, SHDFile);
+    // The whole field is read, so it must not be allocated for streaming
+    PreRun_Influence<O3D, R3D>(params);
     TL<O3D, R3D> tl;
-    tl.Preprocess(params, outputs);
-
-    for(int32_t isx = 0; isx < Pos->NSx; ++isx) {
-        for(int32_t isy = 0; isy < Pos->NSy; ++isy) {
-            for(int32_t itheta = 0; itheta < Pos->Ntheta; ++itheta) {
-                for(int32_t isz = 0; isz < Pos->NSz; ++isz) {
-                    for(int32_t Irz1 = 0; Irz1 < Pos->NRz_per_range; ++Irz1) {
-                        DIFREC(SHDFile, GetRecNum(params, isx, isy, itheta, isz, Irz1));
-                        for(int32_t r = 0; r < Pos->NRr; ++r) {
-                            cpxf v;
-                            DIFREADV(SHDFile, v);
-                            outputs.uAllSources
-                                [GetFieldAddr(isx, isy, isz, itheta, Irz1, r, params.Pos)]
-                                = v;
-                        }
+    tl.AllocateField(params, outputs, false);
+
+    for(int32_t ifreq = 0; ifreq < params.freqinfo->NFieldFreq; ++ifreq) {
+        cpxf *uf = outputs.uAllSources + (size_t)ifreq * GetFieldSize(Pos);
+        for(int32_t isx = 0; isx < Pos->NSx; ++isx) {
+            for(int32_t isy = 0; isy < Pos->NSy; ++isy) {
+                for(int32_t itheta = 0; itheta < Pos->Ntheta; ++itheta) {
+                    for(int32_t isz = 0; isz < Pos->NSz; ++isz) {
+                        DIFREADRECS(
+                            SHDFile, GetRecNum(Pos, isx, isy, itheta, isz, 0, ifreq),
+                            &uf[GetFieldAddr(isx, isy, isz, itheta, 0, 0, Pos)],
+                            Pos->NRz_per_range, Pos->NRr * sizeof(cpxf));
                     }
                 }
             }
@@ -375,4 +493,51 @@ template void ReadOutTL<true, true>(
     bhcParams<true> &params, bhcOutputs<true, true> &outputs, const char *FileRoot);
 #endif
 
+template<bool O3D> SHDView *OpenSHDView(bhcParams<O3D> &params, const char *FileRoot)
+{
+    std::string path = std::string(FileRoot) + ".shd";
+    // LP: The header is small, so it is read normally.
+    DirectIFile SHDFile(GetInternal(params));
+    SHDFile.open(path);
+    ReadSHDHeader(params, SHDFile);
+
+    SHDView *view           = new SHDView(GetInternal(params));
+    view->recl              = SHDFile.reclen();
+    view->Pos.NSx           = params.Pos->NSx;
+    view->Pos.NSy           = params.Pos->NSy;
+    view->Pos.NSz           = params.Pos->NSz;
+    view->Pos.NRz           = params.Pos->NRz;
+    view->Pos.NRr           = params.Pos->NRr;
+    view->Pos.Ntheta        = params.Pos->Ntheta;
+    view->Pos.NRz_per_range = params.Pos->NRz_per_range;
+    view->NFieldFreq        = params.freqinfo->NFieldFreq;
+    // One past the last field record
+    size_t numRecs = GetRecNum(&view->Pos, 0, 0, 0, 0, 0, view->NFieldFreq);
+    try {
+        if((size_t)view->Pos.NRr * sizeof(cpxf) > view->recl) {
+            EXTERR(
+                "NRr in SHDFile being loaded does not fit in its record length %" PRIuMAX,
+                view->recl);
+        }
+        view->file.open(path);
+        if(view->file.length() < numRecs * view->recl) {
+            EXTERR(
+                "SHDFile being loaded is too short (%" PRIuMAX " bytes) for its %" PRIuMAX
+                " records",
+                view->file.length(), numRecs);
+        }
+    } catch(...) {
+        delete view;
+        throw;
+    }
+    return view;
+}
+
+#if BHC_ENABLE_2D
+template SHDView *OpenSHDView<false>(bhcParams<false> &params, const char *FileRoot);
+#endif
+#if BHC_ENABLE_NX2D || BHC_ENABLE_3D
+template SHDView *OpenSHDView<true>(bhcParams<true> &params, const char *FileRoot);
+#endif
+
 }} // namespace bhc::mode
@@ -40,6 +40,69 @@ extern template void WriteOutTL<true, false>(
 extern template void WriteOutTL<true, true>(
     const bhcParams<true> &params, const bhcOutputs<true, true> &outputs);
 
+template<bool O3D, bool R3D> void RunStreamingTL(
+    bhcParams<O3D> &params, bhcOutputs<O3D, R3D> &outputs);
+extern template void RunStreamingTL<false, false>(
+    bhcParams<false> &params, bhcOutputs<false, false> &outputs);
+extern template void RunStreamingTL<true, false>(
+    bhcParams<true> &params, bhcOutputs<true, false> &outputs);
+extern template void RunStreamingTL<true, true>(
+    bhcParams<true> &params, bhcOutputs<true, true> &outputs);
+
+/**
+ * SHD file record of the field at all ranges for the given source, receiver
+ * bearing, and receiver depth. Broadband TL files have all records of the first
+ * frequency, then all of the second, etc.
+ */
+inline size_t GetRecNum(
+    const Position *Pos, int32_t isx, int32_t isy, int32_t itheta, int32_t isz,
+    int32_t Irz1, int32_t ifreq = 0)
+{
+    // clang-format off
+    return        10              + (((((size_t)ifreq
+        * (size_t)Pos->NSx           + (size_t)isx)
+        * (size_t)Pos->NSy           + (size_t)isy)
+        * (size_t)Pos->Ntheta        + (size_t)itheta)
+        * (size_t)Pos->NSz           + (size_t)isz)
+        * (size_t)Pos->NRz_per_range + (size_t)Irz1;
+    // clang-format on
+}
+
+/**
+ * Read-only memory-mapped view of the field in an SHD file, behind
+ * bhc::shd_open(). Pos only holds the counts from the file; its arrays are not
+ * set.
+ */
+struct SHDView {
+    MappedIFile file;
+    size_t recl;
+    Position Pos;
+    int32_t NFieldFreq;
+
+    SHDView(bhcInternal *internal) : file(internal), recl(0), Pos(), NFieldFreq(1) {}
+
+    /// Field at all ranges for one source, bearing, depth, and frequency, or
+    /// nullptr if the indices are out of range.
+    const cpxf *Row(
+        int32_t isx, int32_t isy, int32_t itheta, int32_t isz, int32_t Irz1,
+        int32_t ifreq) const
+    {
+        if(isx < 0 || isx >= Pos.NSx || isy < 0 || isy >= Pos.NSy || itheta < 0
+           || itheta >= Pos.Ntheta || isz < 0 || isz >= Pos.NSz || Irz1 < 0
+           || Irz1 >= Pos.NRz_per_range || ifreq < 0 || ifreq >= NFieldFreq) {
+            return nullptr;
+        }
+        return (const cpxf *)(file.data()
+                              + GetRecNum(&Pos, isx, isy, itheta, isz, Irz1, ifreq)
+                                  * recl);
+    }
+};
+
+template<bool O3D> SHDView *OpenSHDView(bhcParams<O3D> &params, const char *FileRoot);
+extern template SHDView *OpenSHDView<false>(
+    bhcParams<false> &params, const char *FileRoot);
+extern template SHDView *OpenSHDView<true>(bhcParams<true> &params, const char *FileRoot);
+
 template<bool O3D, bool R3D> void ReadOutTL(
     bhcParams<O3D> &params, bhcOutputs<O3D, R3D> &outputs, const char *FileRoot);
 extern template void ReadOutTL<false, false>(
@@ -63,25 +126,70 @@ public:
         bhcParams<O3D> &params, bhcOutputs<O3D, R3D> &outputs) const override
     {
         Field<O3D, R3D>::Preprocess(params, outputs);
+        AllocateField(params, outputs, GetInternal(params)->streamTL);
+    }
 
+    /**
+     * Allocates uAllSources for all sources, or if stream and that does not
+     * fit, for one batch of sources (see RunStreamingTL).
+     */
+    void AllocateField(
+        bhcParams<O3D> &params, bhcOutputs<O3D, R3D> &outputs, bool stream) const
+    {
         trackdeallocate(params, outputs.uAllSources); // Free if previously run
         // for a TL calculation, allocate space for the pressure matrix
-        const Position *Pos = params.Pos;
-        size_t n            = (size_t)Pos->NSz * (size_t)Pos->NSx * (size_t)Pos->NSy
-            * (size_t)Pos->Ntheta * (size_t)Pos->NRz_per_range * (size_t)Pos->NRr;
+        bhcInternal *internal   = GetInternal(params);
+        size_t n                = GetFieldSizeAllFreq(params.Pos, params.freqinfo);
+        internal->streamSources = 0;
+        if(stream && internal->noEnvFil) {
+            // The SHD file is written during run(), to FileRoot
+            EXTERR("Streaming TL (bhcInit::streamTL) requires setting up with a "
+                   "FileRoot");
+        }
+        if(stream) {
+            // Stream if the field does not fit in half of the remaining memory,
+            // leaving the rest for private fields etc.
+            int32_t numSources = GetNumSources<O3D>(params.Pos);
+            size_t perSource   = n / numSources;
+            size_t fit         = (internal->maxMemory - internal->usedMemory) / 2
+                / sizeof(cpxf);
+            if(n > fit) {
+                internal->streamSources = (int32_t)bhc::max(
+                    (size_t)1, bhc::min(fit / perSource, (size_t)numSources));
+                n = perSource * internal->streamSources;
+                internal->PRTFile << "\nStreaming the field in batches of up to "
+                                  << internal->streamSources << " sources\n";
+            }
+        }
         trackallocate(params, "sound field / transmission loss", outputs.uAllSources, n);
-        memset(outputs.uAllSources, 0, n * sizeof(cpxf));
+        internal->pool.FirstTouch(outputs.uAllSources, n);
+    }
+
+    virtual void Run(bhcParams<O3D> &params, bhcOutputs<O3D, R3D> &outputs) const override
+    {
+        if(GetInternal(params)->streamSources > 0) {
+            RunStreamingTL<O3D, R3D>(params, outputs);
+        } else {
+            Field<O3D, R3D>::Run(params, outputs);
+        }
     }
 
     virtual void Postprocess(
         bhcParams<O3D> &params, bhcOutputs<O3D, R3D> &outputs) const override
     {
+        // When streaming, each batch is post-processed as part of Run
+        if(GetInternal(params)->streamSources > 0) return;
         PostProcessTL<O3D, R3D>(params, outputs);
     }
 
     virtual void Writeout(
         const bhcParams<O3D> &params, const bhcOutputs<O3D, R3D> &outputs) const override
     {
+        if(GetInternal(params)->streamSources > 0) {
+            EXTWARN("writeout: The TL field was streamed to the SHD file during "
+                    "run(), and is not written again");
+            return;
+        }
         WriteOutTL<O3D, R3D>(params, outputs);
     }
 
@@ -39,7 +39,10 @@ public:
         Beam->rangeInKm  = true;
         Beam->autoDeltas = false;
 
-        Beam->deltas = RL(0.0);
+        Beam->deltas    = RL(0.0);
+        Beam->stepTol   = RL(0.0);
+        Beam->deltasMin = RL(0.0);
+        Beam->deltasMax = RL(0.0);
         Beam->Box.x = Beam->Box.y = RL(-1.0);
         if constexpr(O3D) Beam->Box.z = RL(-1.0);
 
@@ -129,6 +132,21 @@ public:
         bool boxerr = Beam->Box.x <= RL(0.0) || Beam->Box.y <= RL(0.0);
         if constexpr(O3D) boxerr = boxerr || Beam->Box.z <= RL(0.0);
         if(boxerr) { EXTERR("ReadEnvironment: Beam box not set up correctly"); }
+        if(Beam->stepTol < RL(0.0)) {
+            EXTERR("Beam: stepTol must be non-negative (0 = fixed step size)");
+        }
+        if(Beam->stepTol > RL(0.0)) {
+            real deltasMin, deltasMax;
+            GetStepBounds<O3D>(Beam, deltasMin, deltasMax);
+            if(deltasMin <= RL(0.0) || deltasMax < deltasMin) {
+                EXTERR("Beam: Adaptive step size bounds deltasMin, deltasMax invalid");
+            }
+        }
+        if(Beam->stepTol > RL(0.0) && IsSGBInfl(Beam)) {
+            // The SGB influence computes the arc length as (step index) * deltas
+            EXTERR("Beam: Adaptive step size (stepTol > 0) cannot be used with "
+                   "simple Gaussian beams");
+        }
 
         if(IsGeometricInfl(Beam) || IsSGBInfl(Beam)) {
             NULLSTATEMENT;
@@ -160,6 +178,13 @@ public:
         PRTFile << std::setprecision(4);
         PRTFile << "\n Step length,       deltas = " << std::setw(11) << Beam->deltas
                 << " m\n\n";
+        if(Beam->stepTol > RL(0.0)) {
+            real deltasMin, deltasMax;
+            GetStepBounds<O3D>(Beam, deltasMin, deltasMax);
+            PRTFile << " Adaptive step size, tolerance " << Beam->stepTol
+                    << " m, step length " << deltasMin << " to " << deltasMax
+                    << " m\n\n";
+        }
         if constexpr(O3D) {
             PRTFile << "Maximum ray x-range, Box.x  = " << std::setw(11) << Beam->Box.x
                     << " m\n";
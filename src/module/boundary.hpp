@@ -35,6 +35,8 @@ public:
     {
         BdryInfoTopBot<O3D> *bdinfotb = GetBdryInfoTopBot(params);
         bdinfotb->bd                  = nullptr;
+        bdinfotb->hot                 = nullptr;
+        bdinfotb->gridX.invDx         = bdinfotb->gridY.invDx = RL(0.0);
     }
 
     virtual void SetupPre(bhcParams<O3D> &params) const override
@@ -54,6 +56,7 @@ public:
     virtual void Default(bhcParams<O3D> &params) const override
     {
         BdryInfoTopBot<O3D> *bdinfotb = GetBdryInfoTopBot(params);
+        trackdeallocate(params, bdinfotb->hot);
 
         if constexpr(O3D) {
             bdinfotb->type[0] = 'R';
@@ -429,8 +432,10 @@ public:
     {
         BdryInfoTopBot<O3D> *bdinfotb = GetBdryInfoTopBot(params);
 
+        bool converted = false;
         if(bdinfotb->rangeInKm) {
             bdinfotb->rangeInKm = false;
+            converted           = true;
             // convert km to m
             if constexpr(O3D) {
                 for(int32_t iy = 0; iy < bdinfotb->NPts.y; ++iy) {
@@ -446,7 +451,12 @@ public:
             }
         }
 
-        if(!bdinfotb->dirty) return;
+        if(!bdinfotb->dirty) {
+            // Default() sets up the normals of the flat 3D boundary itself and
+            // clears dirty
+            if(bdinfotb->hot == nullptr || converted) UpdateHot(params, bdinfotb);
+            return;
+        }
         bdinfotb->dirty = false;
 
         ComputeBdryTangentNormal(params, bdinfotb);
@@ -466,12 +476,15 @@ public:
                 }
             }
         }
+
+        UpdateHot(params, bdinfotb);
     }
 
     virtual void Finalize(bhcParams<O3D> &params) const override
     {
         BdryInfoTopBot<O3D> *bdinfotb = GetBdryInfoTopBot(params);
         trackdeallocate(params, bdinfotb->bd);
+        trackdeallocate(params, bdinfotb->hot);
     }
 
 private:
@@ -514,6 +527,40 @@ private:
     constexpr static const char *s_risesdrops          = ISTOP ? "rises above highest"
                                                                : "drops below lowest";
 
+    /**
+     * Copies the geometry needed at every step to the hot array (see
+     * BdryPtHot), and checks whether the 3D grid is uniform (see UniformGrid).
+     */
+    inline void UpdateHot(
+        const bhcParams<O3D> &params, BdryInfoTopBot<O3D> *bdinfotb) const
+    {
+        int32_t n;
+        if constexpr(O3D) {
+            n = bdinfotb->NPts.x * bdinfotb->NPts.y;
+        } else {
+            n = bdinfotb->NPts;
+        }
+        trackallocate(params, s_altimetrybathymetry, bdinfotb->hot, n);
+        for(int32_t i = 0; i < n; ++i) {
+            const BdryPtFull<O3D> &bd = bdinfotb->bd[i];
+            BdryPtHot<O3D> &hot       = bdinfotb->hot[i];
+            hot.x                     = bd.x;
+            if constexpr(O3D) {
+                hot.n1 = bd.n1;
+                hot.n2 = bd.n2;
+            } else {
+                hot.n = bd.n;
+            }
+        }
+        if constexpr(O3D) {
+            bdinfotb->gridX = DetectUniformGrid(
+                &bdinfotb->bd[0].x.x, bdinfotb->NPts.x,
+                bdinfotb->NPts.y * BdryStride<O3D>, 0);
+            bdinfotb->gridY = DetectUniformGrid(
+                &bdinfotb->bd[0].x.y, bdinfotb->NPts.y, BdryStride<O3D>, 0);
+        }
+    }
+
     /**
      * Does some pre-processing on the boundary points to pre-compute segment
      * lengths  (.Len),
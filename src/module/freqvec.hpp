@@ -31,6 +31,8 @@ namespace bhc { namespace module {
  * and putting 'B' there is considered invalid. Plus, freqVec is never read during
  * the beam trace or influence. However, this can't be removed, as the frequency
  * vector must be written out to the shade file.
+ * LP: In broadband TL runs (bhcInit::broadbandTL), the 'B' option is allowed and
+ * the field is computed at each of these frequencies.
  */
 template<bool O3D> class FreqVec : public ParamsModule<O3D> {
 public:
@@ -39,7 +41,8 @@ public:
 
     virtual void Init(bhcParams<O3D> &params) const override
     {
-        params.freqinfo->freqVec = nullptr;
+        params.freqinfo->freqVec    = nullptr;
+        params.freqinfo->NFieldFreq = 1;
     }
     virtual void SetupPre(bhcParams<O3D> &params) const override
     {
@@ -89,12 +92,55 @@ public:
                 Description, Units);
         }
     }
+    virtual void Preprocess(bhcParams<O3D> &params) const override
+    {
+        params.freqinfo->NFieldFreq = 1;
+        if(!GetInternal(params)->broadbandTL || !IsTLRun(params.Beam)) return;
+        if(!IsGeometricInfl(params.Beam)) {
+            EXTERR("Broadband TL requires geometric (hat or Gaussian) beams");
+        }
+        // The complex sound speeds are computed at freq0, and the attenuation
+        // only scaled with omega for the other frequencies, which is only right
+        // if the attenuation in Nepers/m is proportional to frequency.
+        const char *AttenUnit = params.ssp->AttenUnit;
+        if(AttenUnit[1] != ' ') {
+            EXTERR("Broadband TL does not support volume attenuation (Thorp, "
+                   "Francois-Garrison, biological)");
+        }
+        if(AttenUnit[0] != 'W' && AttenUnit[0] != 'F' && AttenUnit[0] != 'Q'
+           && AttenUnit[0] != 'L' && HasAttenuation(params)) {
+            EXTERR("Broadband TL requires attenuation in units proportional to "
+                   "frequency (dB/wavelength, dB/(m kHz), Q, or loss parameter)");
+        }
+        params.freqinfo->NFieldFreq = params.freqinfo->Nfreq;
+    }
     virtual void Finalize(bhcParams<O3D> &params) const override
     {
         trackdeallocate(params, params.freqinfo->freqVec);
     }
 
 private:
+    /// Whether the SSP or either halfspace has any attenuation. (The points
+    /// a hexahedral SSP adds to the profile have NaN attenuation, see
+    /// SegZToZ.)
+    static bool HasAttenuation(const bhcParams<O3D> &params)
+    {
+        const SSPStructure *ssp = params.ssp;
+        if(ssp->Type != 'A') {
+            for(int32_t i = 0; i < ssp->NPts; ++i) {
+                real alphaI = ssp->alphaI[i];
+                if(alphaI != RL(0.0) && !std::isnan(alphaI)) return true;
+            }
+        }
+        for(const HSInfo *hs : {&params.Bdry->Top.hs, &params.Bdry->Bot.hs}) {
+            if(hs->bc == 'G') return true;
+            if(hs->bc == 'A' && (hs->alphaI != RL(0.0) || hs->betaI != RL(0.0))) {
+                return true;
+            }
+        }
+        return false;
+    }
+
     constexpr static const char *Description = "Frequencies";
     constexpr static const char *Units       = "Hz";
 };
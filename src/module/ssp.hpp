@@ -32,18 +32,34 @@ public:
     {
         SSPStructure *ssp = params.ssp;
 
-        ssp->cMat  = nullptr;
-        ssp->czMat = nullptr;
-        ssp->Seg.r = nullptr;
-        ssp->Seg.x = nullptr;
-        ssp->Seg.y = nullptr;
-        ssp->Seg.z = nullptr;
+        ssp->c      = nullptr;
+        ssp->layer  = nullptr;
+        ssp->z      = nullptr;
+        ssp->rho    = nullptr;
+        ssp->alphaR = nullptr;
+        ssp->alphaI = nullptr;
+        ssp->betaR  = nullptr;
+        ssp->betaI  = nullptr;
+        ssp->cMat   = nullptr;
+        ssp->czMat  = nullptr;
+        ssp->Seg.r  = nullptr;
+        ssp->Seg.x  = nullptr;
+        ssp->Seg.y  = nullptr;
+        ssp->Seg.z  = nullptr;
+
+        ssp->NPtsAllocated = 0;
+
+        ssp->table.cell  = nullptr;
+        ssp->table.n     = 0;
+        ssp->table.lossy = false;
+        ssp->gridX.invDx = ssp->gridY.invDx = ssp->gridZ.invDx = RL(0.0);
     }
 
     virtual void SetupPre(bhcParams<O3D> &params) const override
     {
         SSPStructure *ssp = params.ssp;
 
+        ResizeProfile(params, 0, 2);
         ssp->NPts = 2;
         ssp->z[0] = RL(0.0);
         ssp->z[1] = RL(5000.0);
@@ -83,13 +99,18 @@ public:
 
         if(ssp->Type == 'A') return;
 
-        ssp->NPts = 0;
+        ssp->NPts        = 0;
+        int32_t capacity = 0;
 
         while(true) {
             if(ssp->NPts >= MaxSSP) {
                 EXTERR("ReadSSP: Number of SSP points exceeds limit");
                 return;
             }
+            if(ssp->NPts == capacity) {
+                capacity = bhc::min(bhc::max(capacity * 2, 64), MaxSSP);
+                ResizeProfile(params, ssp->NPts, capacity);
+            }
 
             LIST_WARNLINE(ENVFile);
             ENVFile.Read(ssp->z[ssp->NPts]);
@@ -115,6 +136,7 @@ public:
             }
         }
 
+        ResizeProfile(params, ssp->NPts, ssp->NPts);
         ssp->Nz = ssp->NPts;
 
         if(ssp->Type == 'Q') {
@@ -280,6 +302,7 @@ public:
         SSPStructure *ssp = params.ssp;
         if constexpr(!O3D) {
             // quad
+            ResizeProfile(params, ssp->NPts, NPts_Nx);
             ssp->Type = 'Q';
             ssp->NPts = NPts_Nx;
             ssp->Nr   = Nr_Ny;
@@ -297,9 +320,29 @@ public:
         ssp->dirty = true;
     }
 
+    /// Profile for the SSP types other than quad and hexahedral
+    void ExtSetupProfile(bhcParams<O3D> &params, int32_t NPts) const
+    {
+        SSPStructure *ssp = params.ssp;
+        if(NPts < 2 || NPts > MaxSSP) {
+            EXTERR("extsetup_ssp: Invalid number of SSP points %d", NPts);
+        }
+        ResizeProfile(params, ssp->NPts, NPts);
+        ssp->NPts  = NPts;
+        ssp->Nz    = NPts;
+        ssp->dirty = true;
+    }
+
     virtual void Validate(bhcParams<O3D> &params) const override
     {
         SSPStructure *ssp = params.ssp;
+        // Hexahedral: the profile is rebuilt from Seg.z in preprocess
+        if(ssp->Type != 'H' && ssp->NPts > ssp->NPtsAllocated) {
+            EXTERR(
+                "ssp: NPts = %d but the profile arrays only have %d points, "
+                "call extsetup_ssp() to resize them",
+                ssp->NPts, ssp->NPtsAllocated);
+        }
         switch(ssp->Type) {
         case 'N': break;
         case 'C': break;
@@ -464,6 +507,7 @@ public:
 
         if(!ssp->dirty) return;
         ssp->dirty = false;
+        trackdeallocate(params, ssp->table.cell);
 
         if(ssp->Type == 'H') {
             // calculate cz
@@ -479,53 +523,71 @@ public:
                 }
             }
             SegZToZ(params);
+            ssp->gridX = DetectUniformGrid(ssp->Seg.x, ssp->Nx);
+            ssp->gridY = DetectUniformGrid(ssp->Seg.y, ssp->Ny);
+            ssp->gridZ = DetectUniformGrid(ssp->Seg.z, ssp->Nz);
             // LP: ssp->c and ssp->cz are not well-defined in hexahedral mode, and
             // if the number of depths is changed (ssp->Nz vs. ssp->NPts), computing
             // them may read uninitialized data.
             return;
         }
 
-        for(int32_t iz = 0; iz < ssp->NPts; ++iz) {
+        int32_t NPts = ssp->NPts;
+        trackallocate(params, "SSP", ssp->c, NPts);
+        trackallocate(params, "SSP", ssp->layer, NPts);
+        for(int32_t iz = 0; iz < NPts; ++iz) {
             ssp->c[iz] = crci(
                 params, ssp->z[iz], ssp->alphaR[iz], ssp->alphaI[iz], ssp->AttenUnit);
-
-            // compute gradient, cz
-            if(iz > 0)
-                ssp->cz[iz - 1] = (ssp->c[iz] - ssp->c[iz - 1])
-                    / (ssp->z[iz] - ssp->z[iz - 1]);
         }
         // LP: Gradient at last point is uninitialized.
-        ssp->cz[ssp->NPts - 1] = cpx(NAN, NAN);
+        for(int32_t i = 0; i < 4; ++i) ssp->layer[NPts - 1].coef[i] = cpx(NAN, NAN);
 
         switch(ssp->Type) {
+        case 'C': // C-linear profile option
+            // compute gradient, cz
+            for(int32_t iz = 0; iz < NPts - 1; ++iz) {
+                SSPLayer &l = ssp->layer[iz];
+                l.coef[0]   = ssp->c[iz];
+                l.coef[1]
+                    = (ssp->c[iz + 1] - ssp->c[iz]) / (ssp->z[iz + 1] - ssp->z[iz]);
+            }
+            break;
         case 'N': // N2-linear profile option
-            for(int32_t i = 0; i < ssp->NPts; ++i) ssp->n2[i] = FL(1.0) / SQ(ssp->c[i]);
-
-            // compute gradient, n2z
-            for(int32_t iz = 1; iz < ssp->NPts; ++iz) {
-                ssp->n2z[iz - 1] = (ssp->n2[iz] - ssp->n2[iz - 1])
-                    / (ssp->z[iz] - ssp->z[iz - 1]);
+            // compute n2 and gradient, n2z
+            for(int32_t iz = 0; iz < NPts - 1; ++iz) {
+                SSPLayer &l = ssp->layer[iz];
+                l.coef[0]   = FL(1.0) / SQ(ssp->c[iz]);
+                l.coef[2]   = FL(1.0) / SQ(ssp->c[iz + 1]);
+                l.coef[1]   = (l.coef[2] - l.coef[0]) / (ssp->z[iz + 1] - ssp->z[iz]);
             }
             break;
         case 'S': { // Cubic spline profile option
-            for(int32_t i = 0; i < ssp->NPts; ++i) ssp->cSpline[0][i] = ssp->c[i];
+            cpx *spline = nullptr;
+            trackallocate(params, "SSP spline coefficients", spline, 4 * NPts);
+            for(int32_t i = 0; i < NPts; ++i) spline[i] = ssp->c[i];
 
             // Compute spline coefs
             int32_t iBCBeg = 0;
             int32_t iBCEnd = 0;
             cSpline(
-                ssp->z, ssp->cSpline[0], ssp->cSpline[1], ssp->cSpline[2],
-                ssp->cSpline[3], ssp->NPts, iBCBeg, iBCEnd, ssp->NPts);
+                ssp->z, &spline[0], &spline[NPts], &spline[2 * NPts], &spline[3 * NPts],
+                NPts, iBCBeg, iBCEnd, NPts);
+            CopyToLayers(ssp, spline);
+            trackdeallocate(params, spline);
         } break;
-        case 'P': // monotone PCHIP ACS profile option
+        case 'P': { // monotone PCHIP ACS profile option
             //                                                               2      3
             // compute coefficients of std cubic polynomial: c0 + c1*x + c2*x + c3*x
             //
+            cpx *cCoef = nullptr; // followed by the work arrays
+            trackallocate(params, "SSP PCHIP coefficients", cCoef, 8 * NPts);
             pchip(
-                ssp->z, ssp->c, ssp->NPts, ssp->cCoef[0], ssp->cCoef[1], ssp->cCoef[2],
-                ssp->cCoef[3], ssp->CSWork[0], ssp->CSWork[1], ssp->CSWork[2],
-                ssp->CSWork[3]);
-            break;
+                ssp->z, ssp->c, NPts, &cCoef[0], &cCoef[NPts], &cCoef[2 * NPts],
+                &cCoef[3 * NPts], &cCoef[4 * NPts], &cCoef[5 * NPts], &cCoef[6 * NPts],
+                &cCoef[7 * NPts]);
+            CopyToLayers(ssp, cCoef);
+            trackdeallocate(params, cCoef);
+        } break;
         case 'Q':
             // calculate cz
             for(int32_t iSegt = 0; iSegt < ssp->Nr; ++iSegt) {
@@ -539,12 +601,25 @@ public:
             }
             break;
         }
+
+        if(GetInternal(params)->sspTable && (ssp->Type == 'S' || ssp->Type == 'P')) {
+            BuildTable(params);
+        }
     }
 
     virtual void Finalize(bhcParams<O3D> &params) const override
     {
         SSPStructure *ssp = params.ssp;
 
+        trackdeallocate(params, ssp->c);
+        trackdeallocate(params, ssp->layer);
+        trackdeallocate(params, ssp->table.cell);
+        trackdeallocate(params, ssp->z);
+        trackdeallocate(params, ssp->rho);
+        trackdeallocate(params, ssp->alphaR);
+        trackdeallocate(params, ssp->alphaI);
+        trackdeallocate(params, ssp->betaR);
+        trackdeallocate(params, ssp->betaI);
         trackdeallocate(params, ssp->cMat);
         trackdeallocate(params, ssp->czMat);
         trackdeallocate(params, ssp->Seg.r);
@@ -560,13 +635,14 @@ private:
         if(ssp->Nz > MaxSSP) {
             EXTERR("SSP: Hexahedral: Number of z coordinates exceeds limit");
         }
+        ResizeProfile(params, ssp->NPts, ssp->Nz);
+        trackallocate(params, "SSP", ssp->c, ssp->Nz);
         // over-ride the SSP%z values read in from the environmental file with these
         // new values
         for(int32_t iz = 0; iz < ssp->Nz; ++iz) {
             ssp->z[iz] = ssp->Seg.z[iz];
             // LP: These are not well-defined, make sure they're not used
-            ssp->c[iz]  = NAN;
-            ssp->cz[iz] = NAN;
+            ssp->c[iz] = NAN;
         }
         for(int32_t iz = ssp->NPts; iz < ssp->Nz; ++iz) {
             // LP: These are not well-defined, make sure they're not used
@@ -576,6 +652,106 @@ private:
         }
         ssp->NPts = ssp->Nz;
     }
+    /**
+     * (Re)allocates the profile arrays (z, rho, alpha, beta) to n points,
+     * keeping the values of the first keep points (at most the old size). The
+     * other points get the default properties at depth 0.
+     */
+    void ResizeProfile(bhcParams<O3D> &params, int32_t keep, int32_t n) const
+    {
+        SSPStructure *ssp = params.ssp;
+        keep              = bhc::max(bhc::min(bhc::min(keep, n), ssp->NPtsAllocated), 0);
+
+        real **arrays[6] = {&ssp->z,      &ssp->rho,   &ssp->alphaR,
+                            &ssp->alphaI, &ssp->betaR, &ssp->betaI};
+
+        const real defaults[6] = {RL(0.0), RL(1.0), RL(1500.0), RL(0.0), RL(0.0), RL(0.0)};
+        for(int32_t a = 0; a < 6; ++a) {
+            real *old  = *arrays[a];
+            *arrays[a] = nullptr;
+            trackallocate(params, "SSP", *arrays[a], n);
+            if(keep > 0) memcpy(*arrays[a], old, keep * sizeof(real));
+            for(int32_t i = keep; i < n; ++i) (*arrays[a])[i] = defaults[a];
+            trackdeallocate(params, old);
+        }
+        ssp->NPtsAllocated = n;
+    }
+    /// coefs: 4 arrays of NPts, coefficient k of layer iz at coefs[k * NPts + iz]
+    static void CopyToLayers(SSPStructure *ssp, const cpx *coefs)
+    {
+        for(int32_t iz = 0; iz < ssp->NPts; ++iz) {
+            for(int32_t k = 0; k < 4; ++k) {
+                ssp->layer[iz].coef[k] = coefs[k * ssp->NPts + iz];
+            }
+        }
+    }
+    /**
+     * Resamples the cubic spline or PCHIP profile into ssp->table. Each cell
+     * which is entirely within one layer gets that layer's polynomial, expanded
+     * about the top of the cell.
+     */
+    void BuildTable(bhcParams<O3D> &params) const
+    {
+        SSPStructure *ssp = params.ssp;
+        int32_t NPts      = ssp->NPts;
+        real hMin         = ssp->z[NPts - 1] - ssp->z[0];
+        bool lossy        = false;
+        for(int32_t iz = 0; iz < NPts - 1; ++iz) {
+            hMin = bhc::min(hMin, ssp->z[iz + 1] - ssp->z[iz]);
+            for(int32_t k = 0; k < 4; ++k) {
+                const cpx &coef = ssp->layer[iz].coef[k];
+                // LP: Leave invalid PCHIP coefficients to the polynomial
+                // evaluation, which warns about them.
+                if(ssp->Type == 'P' && STD::abs(coef) > RL(1.0e10)) return;
+                if(coef.imag() != RL(0.0)) lossy = true;
+            }
+        }
+        if(!(hMin > RL(0.0))) return;
+        real span = ssp->z[NPts - 1] - ssp->z[0];
+        int32_t n
+            = (int32_t)bhc::min(STD::ceil(RL(4.0) * span / hMin), (real)MaxSSPTable);
+        real dz = span / (real)n;
+
+        SSPTable &tab = ssp->table;
+        trackallocate(params, "SSP table", tab.cell, n);
+        tab.z0     = ssp->z[0];
+        tab.invDz  = RL(1.0) / dz;
+        tab.n      = n;
+        tab.lossy  = lossy;
+        int32_t iz = 0;
+        for(int32_t i = 0; i < n; ++i) {
+            SSPTableCell &cell = tab.cell[i];
+            real zTop          = tab.z0 + (real)i * dz;
+            while(iz < NPts - 2 && zTop >= ssp->z[iz + 1]) ++iz;
+            if(i < n - 1 && zTop + dz > ssp->z[iz + 1]) {
+                cell.iz = -1;
+                for(int32_t k = 0; k < 4; ++k) cell.coef[k] = RL(0.0);
+                continue;
+            }
+            // c and its derivatives at zTop
+            const cpx *k = ssp->layer[iz].coef;
+            real h       = zTop - ssp->z[iz];
+            real c, cz, czz, czzz;
+            if(ssp->Type == 'S') {
+                cpx f, fx, fxx;
+                SplineALL(k[0], k[1], k[2], k[3], h, f, fx, fxx);
+                c    = f.real();
+                cz   = fx.real();
+                czz  = fxx.real();
+                czzz = k[3].real();
+            } else {
+                c    = (k[0] + (k[1] + (k[2] + k[3] * h) * h) * h).real();
+                cz   = (k[1] + (RL(2.0) * k[2] + RL(3.0) * k[3] * h) * h).real();
+                czz  = (RL(2.0) * k[2] + RL(6.0) * k[3] * h).real();
+                czzz = RL(6.0) * k[3].real();
+            }
+            cell.iz      = iz;
+            cell.coef[0] = c;
+            cell.coef[1] = cz * dz;
+            cell.coef[2] = FL(0.5) * czz * SQ(dz);
+            cell.coef[3] = czzz * CUBE(dz) / FL(6.0);
+        }
+    }
     void AllocateArrays(bhcParams<O3D> &params) const
     {
         SSPStructure *ssp = params.ssp;
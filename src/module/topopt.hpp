@@ -170,8 +170,10 @@ public:
         case 'I': break;
         case ' ': break;
         case 'B':
+            if(GetInternal(params)->broadbandTL) break;
             EXTERR("ReadEnvironment: BELLHOP/BELLHOP3D does not properly support "
-                   "wideband runs / freqvec / TopOpt[5] == 'B'");
+                   "wideband runs / freqvec / TopOpt[5] == 'B' (" BHC_PROGRAMNAME
+                   " supports it for TL runs with -broadband / bhcInit::broadbandTL)");
             [[fallthrough]]; // LP: break here would be unreachable
         default: EXTERR("ReadEnvironment: Unknown top option letter in sixth position\n");
         }
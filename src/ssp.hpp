@@ -66,11 +66,20 @@ HOST_DEVICE inline void n2Linear(SSP_2D_FN_ARGS)
     UpdateSSPSegment(x.y, t.y, ssp->z, ssp->NPts, iSeg.z);
     real w = LinInterpDensity(x.y, ssp, iSeg, o.rho);
 
-    o.ccpx = RL(1.0)
-        / STD::sqrt((RL(1.0) - w) * ssp->n2[iSeg.z] + w * ssp->n2[iSeg.z + 1]);
+    const SSPLayer &l = ssp->layer[iSeg.z];
+    const cpx &n2a    = l.coef[0], &n2b = l.coef[2];
+    if(n2a.imag() == RL(0.0) && n2b.imag() == RL(0.0)) {
+        // LP: No attenuation in this layer. Same result as the complex version
+        // below, without the complex sqrt and division, which otherwise dominate
+        // the cost of a step.
+        o.ccpx = cpx(
+            RL(1.0) / STD::sqrt((RL(1.0) - w) * n2a.real() + w * n2b.real()), RL(0.0));
+    } else {
+        o.ccpx = RL(1.0) / STD::sqrt((RL(1.0) - w) * n2a + w * n2b);
+    }
     real c = o.ccpx.real();
 
-    o.gradc = vec2(RL(0.0), RL(-0.5) * CUBE(c) * ssp->n2z[iSeg.z].real());
+    o.gradc = vec2(RL(0.0), RL(-0.5) * CUBE(c) * l.coef[1].real());
     o.crr = o.crz = RL(0.0);
     o.czz         = RL(3.0) * o.gradc.y * o.gradc.y / c;
 }
@@ -83,11 +92,56 @@ HOST_DEVICE inline void cLinear(SSP_2D_FN_ARGS)
     UpdateSSPSegment(x.y, t.y, ssp->z, ssp->NPts, iSeg.z);
     LinInterpDensity(x.y, ssp, iSeg, o.rho);
 
-    o.ccpx  = ssp->c[iSeg.z] + (x.y - ssp->z[iSeg.z]) * ssp->cz[iSeg.z];
-    o.gradc = vec2(RL(0.0), ssp->cz[iSeg.z].real());
+    const SSPLayer &l = ssp->layer[iSeg.z];
+    o.ccpx            = l.coef[0] + (x.y - ssp->z[iSeg.z]) * l.coef[1];
+    o.gradc           = vec2(RL(0.0), l.coef[1].real());
     o.crr = o.crz = o.czz = RL(0.0);
 }
 
+/**
+ * Cubic spline or PCHIP SSP from its uniform-grid table (bhcInit::sspTable):
+ * the cell is found by direct indexing, and c and its derivatives are
+ * evaluated in real arithmetic. Only if the profile has attenuation, the
+ * imaginary part of c is evaluated from the polynomial of the layer.
+ *
+ * returns: false if the cell is not entirely in the ray's layer; then the
+ * caller evaluates the layer's polynomial instead.
+ */
+HOST_DEVICE inline bool SSPTableLookup(
+    real z, SSPOutputs<false> &o, const SSPStructure *ssp, const SSPSegState &iSeg)
+{
+    const SSPTable &tab      = ssp->table;
+    real s                   = (z - tab.z0) * tab.invDz;
+    int32_t i                = bhc::min(bhc::max((int32_t)s, 0), tab.n - 1);
+    const SSPTableCell &cell = tab.cell[i];
+    if(cell.iz != iSeg.z) return false;
+    real u        = s - (real)i;
+    const real *b = cell.coef;
+
+    real c   = b[0] + (b[1] + (b[2] + b[3] * u) * u) * u;
+    real cu  = b[1] + (RL(2.0) * b[2] + RL(3.0) * b[3] * u) * u;
+    real cuu = RL(2.0) * b[2] + RL(6.0) * b[3] * u;
+
+    real ci = RL(0.0);
+    if(tab.lossy) {
+        const cpx *k = ssp->layer[iSeg.z].coef;
+        real h       = z - ssp->z[iSeg.z];
+        if(ssp->Type == 'S') {
+            constexpr float half = FL(0.5), sixth = FL(1.0) / FL(6.0);
+            ci = k[0].imag()
+                + h * (k[1].imag() + h * (half * k[2].imag() + sixth * h * k[3].imag()));
+        } else {
+            ci = k[0].imag() + (k[1].imag() + (k[2].imag() + k[3].imag() * h) * h) * h;
+        }
+    }
+
+    o.ccpx  = cpx(c, ci);
+    o.gradc = vec2(RL(0.0), cu * tab.invDz);
+    o.crr = o.crz = RL(0.0);
+    o.czz         = cuu * SQ(tab.invDz);
+    return true;
+}
+
 /**
  * This implements the new monotone piecewise cubic Hermite interpolating
  * polynomial (PCHIP) algorithm for the interpolation of the sound speed c.
@@ -96,35 +150,31 @@ HOST_DEVICE inline void cPCHIP(SSP_2D_FN_ARGS)
 {
     UpdateSSPSegment(x.y, t.y, ssp->z, ssp->NPts, iSeg.z);
     LinInterpDensity(x.y, ssp, iSeg, o.rho);
+    if(ssp->table.cell != nullptr && SSPTableLookup(x.y, o, ssp, iSeg)) return;
 
     real xt = x.y - ssp->z[iSeg.z];
     if(STD::abs(xt) > RL(1.0e10)) {
         RunWarning(errState, BHC_WARN_CPCHIP_INVALIDXT);
         // printf("Invalid xt %g\n", xt);
     }
+    const cpx *cCoef = ssp->layer[iSeg.z].coef;
     for(int32_t i = 0; i < 4; ++i) {
-        if(STD::abs(ssp->cCoef[i][iSeg.z]) > RL(1.0e10)) {
+        if(STD::abs(cCoef[i]) > RL(1.0e10)) {
             RunWarning(errState, BHC_WARN_CPCHIP_INVALIDCCOEF);
             // printf(
-            //     "Invalid ssp->cCoef[%d][%d] = (%g,%g)\n", i, iSeg.z,
-            //     ssp->cCoef[i][iSeg.z].real(), ssp->cCoef[i][iSeg.z].imag());
+            //     "Invalid cCoef[%d][%d] = (%g,%g)\n", i, iSeg.z, cCoef[i].real(),
+            //     cCoef[i].imag());
         }
     }
 
-    o.ccpx = ssp->cCoef[0][iSeg.z]
-        + (ssp->cCoef[1][iSeg.z]
-           + (ssp->cCoef[2][iSeg.z] + ssp->cCoef[3][iSeg.z] * xt) * xt)
-            * xt;
+    o.ccpx = cCoef[0] + (cCoef[1] + (cCoef[2] + cCoef[3] * xt) * xt) * xt;
 
     o.gradc = vec2(
         RL(0.0),
-        (ssp->cCoef[1][iSeg.z]
-         + (RL(2.0) * ssp->cCoef[2][iSeg.z] + RL(3.0) * ssp->cCoef[3][iSeg.z] * xt) * xt)
-            .real());
+        (cCoef[1] + (RL(2.0) * cCoef[2] + RL(3.0) * cCoef[3] * xt) * xt).real());
 
     o.crr = o.crz = RL(0.0);
-    o.czz
-        = (RL(2.0) * ssp->cCoef[2][iSeg.z] + RL(6.0) * ssp->cCoef[3][iSeg.z] * xt).real();
+    o.czz         = (RL(2.0) * cCoef[2] + RL(6.0) * cCoef[3] * xt).real();
 }
 
 /**
@@ -134,13 +184,14 @@ HOST_DEVICE inline void cCubic(SSP_2D_FN_ARGS)
 {
     UpdateSSPSegment(x.y, t.y, ssp->z, ssp->NPts, iSeg.z);
     LinInterpDensity(x.y, ssp, iSeg, o.rho);
+    if(ssp->table.cell != nullptr && SSPTableLookup(x.y, o, ssp, iSeg)) return;
 
     real hSpline = x.y - ssp->z[iSeg.z];
     cpx czcpx, czzcpx;
 
+    const cpx *cSpline = ssp->layer[iSeg.z].coef;
     SplineALL(
-        ssp->cSpline[0][iSeg.z], ssp->cSpline[1][iSeg.z], ssp->cSpline[2][iSeg.z],
-        ssp->cSpline[3][iSeg.z], hSpline, o.ccpx, czcpx, czzcpx);
+        cSpline[0], cSpline[1], cSpline[2], cSpline[3], hSpline, o.ccpx, czcpx, czzcpx);
 
     // LP: Only for these conversions, BELLHOP uses DBLE() instead of REAL().
     // The manual for DBLE simply says that it converts the argument to double
@@ -228,6 +279,9 @@ HOST_DEVICE inline void Hexahedral(SSP_3D_FN_ARGS)
         //     x.x, x.y, x.z);
     }
 
+    iSeg.x = GridSegStart(x.x, ssp->gridX, ssp->Nx, iSeg.x);
+    iSeg.y = GridSegStart(x.y, ssp->gridY, ssp->Ny, iSeg.y);
+    iSeg.z = GridSegStart(x.z, ssp->gridZ, ssp->Nz, iSeg.z);
     UpdateSSPSegment(x.x, t.x, ssp->Seg.x, ssp->Nx, iSeg.x);
     UpdateSSPSegment(x.y, t.y, ssp->Seg.y, ssp->Ny, iSeg.y);
     UpdateSSPSegment(x.z, t.z, ssp->Seg.z, ssp->Nz, iSeg.z);
@@ -25,12 +25,6 @@ namespace bhc {
 
 // #define STEP_DEBUGGING 1
 
-#ifdef BHC_USE_FLOATS
-#define INFINITESIMAL_STEP_SIZE (RL(1e-3))
-#else
-#define INFINITESIMAL_STEP_SIZE (RL(1e-6))
-#endif
-
 /**
  * interface crossing in depth
  * LP: 3D only:
@@ -270,8 +264,9 @@ HOST_DEVICE inline void TriDiagCrossing(
  */
 template<bool O3D> HOST_DEVICE inline void ReduceStep(
     const VEC23<O3D> &x0, const VEC23<O3D> &urayt, const SSPSegState &iSeg0,
-    BdryState<O3D> &bds, const BeamStructure<O3D> *Beam, const VEC23<O3D> &xs,
-    const SSPStructure *ssp, ErrState *errState, real &h, int32_t &iSmallStepCtr)
+    BdryState<O3D> &bds, const BeamStructure<O3D> *Beam, const RunConstants *rc,
+    const VEC23<O3D> &xs, const SSPStructure *ssp, ErrState *errState, real &h,
+    int32_t &iSmallStepCtr)
 {
     VEC23<O3D> x;
     real hInt, hBoxxr, hBoxyz, hBoxz_, hTop, hBot, hxSeg, hySeg, hTopDiag, hBotDiag;
@@ -329,9 +324,8 @@ template<bool O3D> HOST_DEVICE inline void ReduceStep(
         RunWarning(errState, BHC_WARN_STEP_NEGATIVE_H);
         // printf("ReduceStep: negative h %f\n", h);
     }
-    if(h < INFINITESIMAL_STEP_SIZE * Beam->deltas) { // is it taking an infinitesimal
-                                                     // step?
-        h = INFINITESIMAL_STEP_SIZE * Beam->deltas;  // make sure we make some motion
+    if(h < rc->hMin) {   // is it taking an infinitesimal step?
+        h = rc->hMin;    // make sure we make some motion
         ++iSmallStepCtr; // keep a count of the number of sequential small steps
 #ifdef STEP_DEBUGGING
         printf("Small step forced to %g\n", h);
@@ -342,19 +336,19 @@ template<bool O3D> HOST_DEVICE inline void ReduceStep(
 }
 
 /**
+ * h: on input, the maximum step size; on output, the step taken.
  * snapDim: See OceanToRayX.
  */
 template<bool O3D> HOST_DEVICE inline void StepToBdry(
     const VEC23<O3D> &x0, VEC23<O3D> &x2, const VEC23<O3D> &urayt, real &h, bool &topRefl,
     bool &botRefl, int32_t &snapDim, const SSPSegState &iSeg0, BdryState<O3D> &bds,
-    const BeamStructure<O3D> *Beam, const VEC23<O3D> &xs, const SSPStructure *ssp,
-    ErrState *errState)
+    const BeamStructure<O3D> *Beam, const RunConstants *rc, const VEC23<O3D> &xs,
+    const SSPStructure *ssp, ErrState *errState)
 {
 #ifdef STEP_DEBUGGING
     printf("StepToBdry\n");
 #endif
-    // Original step due to maximum step size
-    h       = Beam->deltas;
+    // Original step due to maximum step size (h on input)
     x2      = x0 + h * urayt;
     snapDim = -1;
 
@@ -386,8 +380,8 @@ template<bool O3D> HOST_DEVICE inline void StepToBdry(
     }
 
     // is it taking an infinitesimal step?
-    if(h < INFINITESIMAL_STEP_SIZE * Beam->deltas) {
-        h       = INFINITESIMAL_STEP_SIZE * Beam->deltas; // make sure we make some motion
+    if(h < rc->hMin) {
+        h       = rc->hMin; // make sure we make some motion
         x2      = x0 + h * urayt;
         snapDim = -1;
 #ifdef STEP_DEBUGGING
@@ -652,12 +646,16 @@ template<bool R3D> HOST_DEVICE inline void CurvatureCorrection(
 
 /**
  * Does a single step along the ray
+ *
+ * hStep: adaptive step size mode (Beam->stepTol > 0) only, the step size to try
+ * first; updated to the step size for the next step.
  */
 template<typename CFG, bool O3D, bool R3D> HOST_DEVICE inline void Step(
     rayPt<R3D> ray0, rayPt<R3D> &ray2, BdryState<O3D> &bds,
-    const BeamStructure<O3D> *Beam, const VEC23<O3D> &xs, const Origin<O3D, R3D> &org,
-    const SSPStructure *ssp, SSPSegState &iSeg, ErrState *errState,
-    int32_t &iSmallStepCtr, bool &topRefl, bool &botRefl)
+    const BeamStructure<O3D> *Beam, const RunConstants *rc, const VEC23<O3D> &xs,
+    const Origin<O3D, R3D> &org, const SSPStructure *ssp, SSPSegState &iSeg,
+    ErrState *errState, int32_t &iSmallStepCtr, real &hStep, bool &topRefl,
+    bool &botRefl)
 {
     rayPt<R3D> ray1;
     SSPOutputs<R3D> o0, o1, o2;
@@ -710,59 +708,93 @@ template<typename CFG, bool O3D, bool R3D> HOST_DEVICE inline void Step(
 
     csq0   = SQ(o0.ccpx.real());
     urayt0 = o0.ccpx.real() * ray0.t; // unit tangent
-    h      = Beam->deltas; // initially set the step h, to the basic one, deltas
 
     // printf("urayt0 (%g,%g)\n", urayt0.x, urayt0.y);
 
-    // reduce h to land on boundary
+    // Initially set the step h to the basic one, deltas, or in adaptive mode to
+    // the step chosen at the end of the previous step. In adaptive mode, the
+    // difference between the full step and the Euler step of phase 1 estimates
+    // the local error; if it is too large, phases 1 and 2 are redone with a
+    // shorter step.
+    bool adaptive  = rc->adaptive;
+    real hTrial    = adaptive ? hStep : Beam->deltas;
     VEC23<O3D> x_o = RayToOceanX(ray0.x, org);
-    VEC23<O3D> t_o = RayToOceanT(urayt0, org);
-    ReduceStep<O3D>(x_o, t_o, iSeg0, bds, Beam, xs, ssp, errState, h, iSmallStepCtr);
-    // printf("out h, urayt0 %20.17f (%20.17f, %20.17f)\n", h, urayt0.x, urayt0.y);
-    real halfh = FL(0.5) * h; // first step of the modified polygon method is a half step
-
-    ray1.x = ray0.x + halfh * urayt0;
-    ray1.t = ray0.t - halfh * o0.gradc / csq0;
-    UpdateRayPQ<R3D>(ray1, ray0, halfh, pq0);
-
-    // printf("ray1 x t p q (%20.17f,%20.17f) (%20.17f,%20.17f) (%20.17f,%20.17f)
-    // (%20.17f,%20.17f)\n",
-    //     ray1.x.x, ray1.x.y, ray1.t.x, ray1.t.y, ray1.p.x, ray1.p.y, ray1.q.x,
-    //     ray1.q.y);
-
-    // *** Phase 2
-
-    EvaluateSSP<CFG, O3D, R3D>(ray1.x, ray1.t, o1, org, ssp, iSeg, errState);
-    Get_c_partials<R3D>(ray1, o1, part1);
-    pq1 = ComputeDeltaPQ<R3D>(ray1, o1, part1);
-
-    // The Munk test case with a horizontally launched ray caused problems.
-    // The ray vertexes on an interface and can ping-pong around that interface.
-    // Have to be careful in that case about big changes to the stepsize (that invalidate
-    // the leap-frog scheme) in phase II. A modified Heun or Box method could also work.
-
-    csq1   = SQ(o1.ccpx.real());
-    urayt1 = o1.ccpx.real() * ray1.t; // unit tangent
-
-    // printf("urayt1 (%g,%g)\n", urayt1.x, urayt1.y);
-
-    // reduce h to land on boundary
-    t_o = RayToOceanT(urayt1, org);
-    ReduceStep<O3D>(x_o, t_o, iSeg0, bds, Beam, xs, ssp, errState, h, iSmallStepCtr);
+    VEC23<O3D> t_o;
+    VEC23<R3D> urayt2;
+    while(true) {
+        h = hTrial;
+
+        // reduce h to land on boundary
+        t_o = RayToOceanT(urayt0, org);
+        ReduceStep<O3D>(
+            x_o, t_o, iSeg0, bds, Beam, rc, xs, ssp, errState, h, iSmallStepCtr);
+        // printf("out h, urayt0 %20.17f (%20.17f, %20.17f)\n", h, urayt0.x, urayt0.y);
+        real halfh = FL(0.5) * h; // first step of the modified polygon method is a
+                                  // half step
+
+        ray1.x = ray0.x + halfh * urayt0;
+        ray1.t = ray0.t - halfh * o0.gradc / csq0;
+        UpdateRayPQ<R3D>(ray1, ray0, halfh, pq0);
+
+        // printf("ray1 x t p q (%20.17f,%20.17f) (%20.17f,%20.17f) (%20.17f,%20.17f)
+        // (%20.17f,%20.17f)\n",
+        //     ray1.x.x, ray1.x.y, ray1.t.x, ray1.t.y, ray1.p.x, ray1.p.y, ray1.q.x,
+        //     ray1.q.y);
+
+        // *** Phase 2
+
+        EvaluateSSP<CFG, O3D, R3D>(ray1.x, ray1.t, o1, org, ssp, iSeg, errState);
+        Get_c_partials<R3D>(ray1, o1, part1);
+        pq1 = ComputeDeltaPQ<R3D>(ray1, o1, part1);
+
+        // The Munk test case with a horizontally launched ray caused problems.
+        // The ray vertexes on an interface and can ping-pong around that interface.
+        // Have to be careful in that case about big changes to the stepsize (that
+        // invalidate the leap-frog scheme) in phase II. A modified Heun or Box method
+        // could also work.
+
+        csq1   = SQ(o1.ccpx.real());
+        urayt1 = o1.ccpx.real() * ray1.t; // unit tangent
+
+        // printf("urayt1 (%g,%g)\n", urayt1.x, urayt1.y);
+
+        // reduce h to land on boundary
+        t_o = RayToOceanT(urayt1, org);
+        ReduceStep<O3D>(
+            x_o, t_o, iSeg0, bds, Beam, rc, xs, ssp, errState, h, iSmallStepCtr);
+
+        // use blend of f' based on proportion of a full step used.
+        w1 = h / (RL(2.0) * halfh);
+        w0 = RL(1.0) - w1;
+        // printf("w1 %20.17f w0 %20.17f\n", w1, w0);
+        urayt2 = w0 * urayt0 + w1 * urayt1;
+        if(!adaptive) break;
+
+        real err = h * glm::length(urayt2 - urayt0);
+        if(err > Beam->stepTol && hTrial > rc->deltasMin) {
+            real shrink = bhc::max(RL(0.9) * STD::sqrt(Beam->stepTol / err), RL(0.2));
+            hTrial      = bhc::max(bhc::min(h, hTrial) * shrink, rc->deltasMin);
+            iSeg        = iSeg0;
+            continue;
+        }
+        // The error grows as h^2; scale it to the trial step, in case h was
+        // reduced to land on a boundary.
+        err *= SQ(hTrial / h);
+        real grow = err > RL(0.0) ? RL(0.9) * STD::sqrt(Beam->stepTol / err) : RL(5.0);
+        hStep     = bhc::min(
+            bhc::max(hTrial * bhc::min(grow, RL(5.0)), rc->deltasMin), rc->deltasMax);
+        break;
+    }
 
-    // use blend of f' based on proportion of a full step used.
-    w1 = h / (RL(2.0) * halfh);
-    w0 = RL(1.0) - w1;
-    // printf("w1 %20.17f w0 %20.17f\n", w1, w0);
-    VEC23<R3D> urayt2 = w0 * urayt0 + w1 * urayt1;
     // Take the blended ray tangent (urayt2) and find the minimum step size (h)
     // to put this on a boundary, and ensure that the resulting position
     // (ray2.x) gets put precisely on the boundary.
     VEC23<O3D> x2_o;
     t_o = RayToOceanT(urayt2, org);
+    h   = hTrial;
     int32_t snapDim;
     StepToBdry<O3D>(
-        x_o, x2_o, t_o, h, topRefl, botRefl, snapDim, iSeg0, bds, Beam, xs, ssp,
+        x_o, x2_o, t_o, h, topRefl, botRefl, snapDim, iSeg0, bds, Beam, rc, xs, ssp,
         errState);
     ray2.x = OceanToRayX(x2_o, org, urayt2, snapDim, errState);
 #ifdef STEP_DEBUGGING
@@ -781,7 +813,14 @@ template<typename CFG, bool O3D, bool R3D> HOST_DEVICE inline void Step(
     hw0      = h * w0;
     hw1      = h * w1;
     ray2.t   = ray0.t - hw0 * o0.gradc / csq0 - hw1 * o1.gradc / csq1;
-    ray2.tau = ray0.tau + hw0 / o0.ccpx + hw1 / o1.ccpx;
+    if(o0.ccpx.imag() == RL(0.0) && o1.ccpx.imag() == RL(0.0)) {
+        // LP: Lossless medium; avoid the complex divisions, same result.
+        ray2.tau = cpx(
+            ray0.tau.real() + hw0 / o0.ccpx.real() + hw1 / o1.ccpx.real(),
+            ray0.tau.imag());
+    } else {
+        ray2.tau = ray0.tau + hw0 / o0.ccpx + hw1 / o1.ccpx;
+    }
     UpdateRayPQ<R3D>(ray2, ray0, hw0, pq0);
     UpdateRayPQ<R3D>(ray2, ray2, hw1, pq1); // Not a typo, accumulating into 2
 
@@ -66,6 +66,22 @@ template<typename CFG, bool O3D> HOST_DEVICE inline SSPOutputs<O3D> RayStartNomi
     return o;
 }
 
+/**
+ * LP: Sets the launch angles of the ray from its indices.
+ */
+template<bool O3D> HOST_DEVICE inline void RayInitAngles(
+    RayInitInfo &rinit, const AnglesStructure *Angles)
+{
+    rinit.alpha        = Angles->alpha.angles[rinit.ialpha]; // initial angle
+    rinit.SrcDeclAngle = RadDeg * rinit.alpha; // take-off declination angle in degrees
+    if constexpr(O3D) {
+        rinit.beta         = Angles->beta.angles[rinit.ibeta];
+        rinit.SrcAzimAngle = RadDeg * rinit.beta; // take-off azimuthal   angle in degrees
+    } else {
+        rinit.beta = rinit.SrcAzimAngle = NAN;
+    }
+}
+
 /**
  * LP: Pulled out ray update loop initialization. Returns whether to continue
  * with the ray trace. Only call for valid ialpha w.r.t. Angles->iSingleAlpha.
@@ -79,7 +95,7 @@ template<typename CFG, bool O3D, bool R3D> HOST_DEVICE inline bool RayInit(
     BdryState<O3D> &bds, BdryType &Bdry, const BdryType *ConstBdry,
     const BdryInfo<O3D> *bdinfo, const SSPStructure *ssp, const Position *Pos,
     const AnglesStructure *Angles, const FreqInfo *freqinfo,
-    const BeamStructure<O3D> *Beam, const SBPInfo *sbp, ErrState *errState)
+    const BeamStructure<O3D> *Beam, const RunConstants *rc, ErrState *errState)
 {
     if(rinit.isz < 0 || rinit.isz >= Pos->NSz || rinit.ialpha < 0
        || rinit.ialpha >= Angles->alpha.n
@@ -95,14 +111,7 @@ template<typename CFG, bool O3D, bool R3D> HOST_DEVICE inline bool RayInit(
 
     // LP: This part from BellhopCore
 
-    rinit.alpha        = Angles->alpha.angles[rinit.ialpha]; // initial angle
-    rinit.SrcDeclAngle = RadDeg * rinit.alpha; // take-off declination angle in degrees
-    if constexpr(O3D) {
-        rinit.beta         = Angles->beta.angles[rinit.ibeta];
-        rinit.SrcAzimAngle = RadDeg * rinit.beta; // take-off azimuthal   angle in degrees
-    } else {
-        rinit.beta = rinit.SrcAzimAngle = NAN;
-    }
+    RayInitAngles<O3D>(rinit, Angles);
 
     iSeg.x = iSeg.y = iSeg.z = iSeg.r = 0;
     VEC23<O3D> tinit;
@@ -116,15 +125,16 @@ template<typename CFG, bool O3D, bool R3D> HOST_DEVICE inline bool RayInit(
         org.tradial = vec2(STD::cos(rinit.beta), STD::sin(rinit.beta));
     }
 
-    if constexpr(!O3D) {
-        // Are there enough beams?
+    // Are there enough beams? Only checked once per source (the warning is
+    // only raised for the first ray), as it depends on the sound speed there.
+    if(!O3D && IsCoherentRun(Beam) && rinit.ialpha == 0) {
         real DalphaOpt = STD::sqrt(
             o.ccpx.real() / (FL(6.0) * freqinfo->freq0 * Pos->Rr[Pos->NRr - 1]));
         int32_t NalphaOpt = 2
             + (int)((Angles->alpha.angles[Angles->alpha.n - 1] - Angles->alpha.angles[0])
                     / DalphaOpt);
 
-        if(IsCoherentRun(Beam) && Angles->alpha.n < NalphaOpt && rinit.ialpha == 0) {
+        if(Angles->alpha.n < NalphaOpt) {
             RunWarning(errState, BHC_WARN_TOO_FEW_BEAMS);
             // printf(
             //     "Warning in " BHC_PROGRAMNAME
@@ -133,16 +143,8 @@ template<typename CFG, bool O3D, bool R3D> HOST_DEVICE inline bool RayInit(
         }
     }
 
-    int32_t ibp = BinarySearchLEQ(sbp->SrcBmPat, sbp->NSBPPts, 2, 0, rinit.SrcDeclAngle);
-    // LP: Our function won't ever go outside the table, but we need to limit it
-    // to 2 from the end.
-    ibp = bhc::min(ibp, sbp->NSBPPts - 2);
-
-    // linear interpolation to get amplitude
-    real s = (rinit.SrcDeclAngle - sbp->SrcBmPat[2 * ibp + 0])
-        / (sbp->SrcBmPat[2 * (ibp + 1) + 0] - sbp->SrcBmPat[2 * ibp + 0]);
-    float Amp0 = (FL(1.0) - s) * sbp->SrcBmPat[2 * ibp + 1]
-        + s * sbp->SrcBmPat[2 * (ibp + 1) + 1]; // initial amplitude
+    // Source beam pattern, interpolated once per run in SetupRunConstants()
+    float Amp0 = rc->srcAmp[rinit.ialpha]; // initial amplitude
 
     // Lloyd mirror pattern for semi-coherent option
     if(IsSemiCoherentRun(Beam)) {
@@ -273,15 +275,16 @@ template<typename CFG, bool O3D, bool R3D> HOST_DEVICE inline bool RayInit(
  */
 template<typename CFG, bool O3D, bool R3D> HOST_DEVICE inline bool RayUpdate(
     const rayPt<R3D> &point0, rayPt<R3D> &point1, rayPt<R3D> &point2, real &DistEndTop,
-    real &DistEndBot, int32_t &iSmallStepCtr, const Origin<O3D, R3D> &org,
+    real &DistEndBot, int32_t &iSmallStepCtr, real &hStep, const Origin<O3D, R3D> &org,
     SSPSegState &iSeg, BdryState<O3D> &bds, BdryType &Bdry, const BdryInfo<O3D> *bdinfo,
     const ReflectionInfo *refl, const SSPStructure *ssp, const FreqInfo *freqinfo,
-    const BeamStructure<O3D> *Beam, const VEC23<O3D> &xs, ErrState *errState)
+    const BeamStructure<O3D> *Beam, const RunConstants *rc, const VEC23<O3D> &xs,
+    ErrState *errState)
 {
     bool topRefl, botRefl;
     Step<CFG, O3D, R3D>(
-        point0, point1, bds, Beam, xs, org, ssp, iSeg, errState, iSmallStepCtr, topRefl,
-        botRefl);
+        point0, point1, bds, Beam, rc, xs, org, ssp, iSeg, errState, iSmallStepCtr,
+        hStep, topRefl, botRefl);
     /*
     if(point0.x == point1.x){
         printf("Ray did not move from (%g,%g), bailing\n", point0.x.x, point0.x.y);
@@ -392,8 +395,8 @@ template<bool O3D, bool R3D> HOST_DEVICE inline bool RayTerminate(
     const rayPt<R3D> &point, int32_t &Nsteps, int32_t is, const VEC23<O3D> &xs,
     const int32_t &iSmallStepCtr, real &DistBegTop, real &DistBegBot,
     const real &DistEndTop, const real &DistEndBot, int32_t MaxPointsPerRay,
-    const Origin<O3D, R3D> &org, [[maybe_unused]] const BdryInfo<O3D> *bdinfo,
-    const BeamStructure<O3D> *Beam, ErrState *errState)
+    const Origin<O3D, R3D> &org, const BeamStructure<O3D> *Beam,
+    [[maybe_unused]] const RunConstants *rc, ErrState *errState)
 {
     bool leftbox, escapedboundaries, toomanysmallsteps;
     if constexpr(O3D) {
@@ -404,14 +407,8 @@ template<bool O3D, bool R3D> HOST_DEVICE inline bool RayTerminate(
         leftbox = IsOutsideBeamBoxDim<true, 0>(x_o, Beam, xs)
             || IsOutsideBeamBoxDim<true, 1>(x_o, Beam, xs)
             || IsOutsideBeamBoxDim<true, 2>(x_o, Beam, xs);
-        real minx = bhc::max(bdinfo->bot.bd[0].x.x, bdinfo->top.bd[0].x.x);
-        real miny = bhc::max(bdinfo->bot.bd[0].x.y, bdinfo->top.bd[0].x.y);
-        real maxx = bhc::min(
-            bdinfo->bot.bd[(bdinfo->bot.NPts.x - 1) * bdinfo->bot.NPts.y].x.x,
-            bdinfo->top.bd[(bdinfo->top.NPts.x - 1) * bdinfo->top.NPts.y].x.x);
-        real maxy = bhc::min(
-            bdinfo->bot.bd[bdinfo->bot.NPts.y - 1].x.y,
-            bdinfo->top.bd[bdinfo->top.NPts.y - 1].x.y);
+        real minx = rc->bdryMinX, miny = rc->bdryMinY;
+        real maxx = rc->bdryMaxX, maxy = rc->bdryMaxY;
         bool escaped0bdry, escapedNbdry;
         escaped0bdry = x_o.x < minx || x_o.y < miny;
         escapedNbdry = x_o.x > maxx || x_o.y > maxy;
@@ -484,7 +481,7 @@ template<typename CFG, bool O3D, bool R3D> HOST_DEVICE inline void MainRayMode(
     Origin<O3D, R3D> &org, const BdryType *ConstBdry, const BdryInfo<O3D> *bdinfo,
     const ReflectionInfo *refl, const SSPStructure *ssp, const Position *Pos,
     const AnglesStructure *Angles, const FreqInfo *freqinfo,
-    const BeamStructure<O3D> *Beam, const SBPInfo *sbp, ErrState *errState)
+    const BeamStructure<O3D> *Beam, const RunConstants *rc, ErrState *errState)
 {
     real DistBegTop, DistEndTop, DistBegBot, DistEndBot;
     SSPSegState iSeg;
@@ -494,19 +491,21 @@ template<typename CFG, bool O3D, bool R3D> HOST_DEVICE inline void MainRayMode(
 
     if(!RayInit<CFG, O3D, R3D>(
            rinit, xs, ray[0], gradc, DistBegTop, DistBegBot, org, iSeg, bds, Bdry,
-           ConstBdry, bdinfo, ssp, Pos, Angles, freqinfo, Beam, sbp, errState)) {
+           ConstBdry, bdinfo, ssp, Pos, Angles, freqinfo, Beam, rc, errState)) {
         Nsteps = 1;
         return;
     }
 
     int32_t iSmallStepCtr = 0;
-    int32_t is            = 0; // index for a step along the ray
+    real hStep            = Beam->deltas; // adaptive step size only
+    int32_t is            = 0;            // index for a step along the ray
 
     while(true) {
         if(HasErrored(errState)) break;
         bool twoSteps = RayUpdate<CFG, O3D, R3D>(
-            ray[is], ray[is + 1], ray[is + 2], DistEndTop, DistEndBot, iSmallStepCtr, org,
-            iSeg, bds, Bdry, bdinfo, refl, ssp, freqinfo, Beam, xs, errState);
+            ray[is], ray[is + 1], ray[is + 2], DistEndTop, DistEndBot, iSmallStepCtr,
+            hStep, org, iSeg, bds, Bdry, bdinfo, refl, ssp, freqinfo, Beam, rc, xs,
+            errState);
         if(Nsteps >= 0 && is >= Nsteps) {
             Nsteps = is + 2;
             break;
@@ -514,7 +513,7 @@ template<typename CFG, bool O3D, bool R3D> HOST_DEVICE inline void MainRayMode(
         is += (twoSteps ? 2 : 1);
         if(RayTerminate<O3D, R3D>(
                ray[is], Nsteps, is, xs, iSmallStepCtr, DistBegTop, DistBegBot, DistEndTop,
-               DistEndBot, MaxPointsPerRay, org, bdinfo, Beam, errState))
+               DistEndBot, MaxPointsPerRay, org, Beam, rc, errState))
             break;
     }
 }
@@ -526,8 +525,8 @@ template<typename CFG, bool O3D, bool R3D> HOST_DEVICE inline void MainFieldMode
     RayInitInfo &rinit, cpxf *uAllSources, const BdryType *ConstBdry,
     const BdryInfo<O3D> *bdinfo, const ReflectionInfo *refl, const SSPStructure *ssp,
     const Position *Pos, const AnglesStructure *Angles, const FreqInfo *freqinfo,
-    const BeamStructure<O3D> *Beam, const SBPInfo *sbp, EigenInfo *eigen,
-    const ArrInfo *arrinfo, ErrState *errState)
+    const BeamStructure<O3D> *Beam, const RunConstants *rc, EigenInfo *eigen,
+    const ArrInfo *arrinfo, int32_t worker, bool exclusiveField, ErrState *errState)
 {
     real DistBegTop, DistEndTop, DistBegBot, DistEndBot;
     SSPSegState iSeg;
@@ -543,23 +542,26 @@ template<typename CFG, bool O3D, bool R3D> HOST_DEVICE inline void MainFieldMode
 
     if(!RayInit<CFG, O3D, R3D>(
            rinit, xs, point0, gradc, DistBegTop, DistBegBot, org, iSeg, bds, Bdry,
-           ConstBdry, bdinfo, ssp, Pos, Angles, freqinfo, Beam, sbp, errState)) {
+           ConstBdry, bdinfo, ssp, Pos, Angles, freqinfo, Beam, rc, errState)) {
         return;
     }
 
     Init_Influence<CFG, O3D, R3D>(
         inflray, point0, rinit, gradc, Pos, org, ssp, iSeg, Angles, freqinfo, Beam,
         errState);
+    inflray.exclusiveField = exclusiveField;
+    inflray.worker         = worker;
 
     int32_t iSmallStepCtr = 0;
-    int32_t is            = 0; // index for a step along the ray
+    real hStep            = Beam->deltas; // adaptive step size only
+    int32_t is            = 0;            // index for a step along the ray
     int32_t Nsteps        = 0; // not actually needed in TL mode, debugging only
 
     while(true) {
         if(HasErrored(errState)) break;
         bool twoSteps = RayUpdate<CFG, O3D, R3D>(
-            point0, point1, point2, DistEndTop, DistEndBot, iSmallStepCtr, org, iSeg, bds,
-            Bdry, bdinfo, refl, ssp, freqinfo, Beam, xs, errState);
+            point0, point1, point2, DistEndTop, DistEndBot, iSmallStepCtr, hStep, org,
+            iSeg, bds, Bdry, bdinfo, refl, ssp, freqinfo, Beam, rc, xs, errState);
         if(!Step_Influence<CFG, O3D, R3D>(
                point0, point1, inflray, is, uAllSources, ConstBdry, org, ssp, iSeg, Pos,
                Beam, eigen, arrinfo, errState)) {
@@ -581,11 +583,48 @@ template<typename CFG, bool O3D, bool R3D> HOST_DEVICE inline void MainFieldMode
         }
         if(RayTerminate<O3D, R3D>(
                point0, Nsteps, is, xs, iSmallStepCtr, DistBegTop, DistBegBot, DistEndTop,
-               DistEndBot, MaxN, org, bdinfo, Beam, errState))
+               DistEndBot, MaxN, org, Beam, rc, errState))
             break;
     }
 
     // printf("Nsteps %d\n", Nsteps);
 }
 
+/**
+ * Influence of a ray which has already been traced (see bhcInit::rayCache),
+ * for TL and arrivals runs. Gives the same contributions as MainFieldModes
+ * for the ray, which steps the influence over the same points in the same
+ * order. Only for non-Cerveny influence types, which do not evaluate the SSP.
+ */
+template<typename CFG, bool O3D, bool R3D> HOST_DEVICE inline void ReplayFieldModes(
+    RayInitInfo &rinit, const RayResult<O3D, R3D> &res, cpxf *uAllSources,
+    const BdryType *ConstBdry, const SSPStructure *ssp, const Position *Pos,
+    const AnglesStructure *Angles, const FreqInfo *freqinfo,
+    const BeamStructure<O3D> *Beam, EigenInfo *eigen, const ArrInfo *arrinfo,
+    int32_t worker, bool exclusiveField, ErrState *errState)
+{
+    static_assert(!CFG::infl::IsCerveny(), "Cerveny beams cannot be replayed");
+    // LP: Rays which RayInit rejected have only the initial point.
+    if(res.ray == nullptr || res.Nsteps < 2) return;
+
+    RayInitAngles<O3D>(rinit, Angles);
+    SSPSegState iSeg;
+    iSeg.x = iSeg.y = iSeg.z = iSeg.r = 0;
+    VEC23<O3D> gradc(RL(0.0)); // LP: Only used by Cerveny
+    InfluenceRayInfo<R3D> inflray;
+    Init_Influence<CFG, O3D, R3D>(
+        inflray, res.ray[0], rinit, gradc, Pos, res.org, ssp, iSeg, Angles, freqinfo,
+        Beam, errState);
+    inflray.exclusiveField = exclusiveField;
+    inflray.worker         = worker;
+
+    for(int32_t is = 0; is < res.Nsteps - 1; ++is) {
+        if(HasErrored(errState)) break;
+        if(!Step_Influence<CFG, O3D, R3D>(
+               res.ray[is], res.ray[is + 1], inflray, is, uAllSources, ConstBdry,
+               res.org, ssp, iSeg, Pos, Beam, eigen, arrinfo, errState))
+            break;
+    }
+}
+
 } // namespace bhc
@@ -158,4 +158,62 @@ template<typename INT> HOST_DEVICE inline INT AtomicFetchAdd(INT *ptr, INT val)
 #endif
 }
 
+/**
+ * Atomic compare-and-swap: if *ptr == expected, set it to desired. Returns the
+ * previous value of *ptr (== expected if successful).
+ */
+HOST_DEVICE inline int32_t AtomicCAS(int32_t *ptr, int32_t expected, int32_t desired)
+{
+#ifdef __CUDA_ARCH__
+    return atomicCAS(ptr, expected, desired);
+#elif defined(__GNUC__)
+    __atomic_compare_exchange_n(
+        ptr, &expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+    return expected;
+#elif defined(_MSC_VER)
+    return InterlockedCompareExchange((LONG *)ptr, (LONG)desired, (LONG)expected);
+#else
+#error "Unrecognized compiler for atomic intrinsics!"
+#endif
+}
+
+/**
+ * Minimal spin lock on an int32_t which is 0 when unlocked. Only for very short
+ * critical sections.
+ */
+HOST_DEVICE inline void SpinLock(int32_t *lock)
+{
+#ifdef __CUDA_ARCH__
+    while(atomicCAS(lock, 0, 1) != 0)
+        ;
+    __threadfence();
+#elif defined(__GNUC__)
+    while(__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE) != 0) {
+        while(__atomic_load_n(lock, __ATOMIC_RELAXED) != 0)
+            ;
+    }
+#elif defined(_MSC_VER)
+    while(InterlockedExchange((LONG *)lock, 1) != 0) {
+        while(*(volatile LONG *)lock != 0)
+            ;
+    }
+#else
+#error "Unrecognized compiler for atomic intrinsics!"
+#endif
+}
+
+HOST_DEVICE inline void SpinUnlock(int32_t *lock)
+{
+#ifdef __CUDA_ARCH__
+    __threadfence();
+    atomicExch(lock, 0);
+#elif defined(__GNUC__)
+    __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+#elif defined(_MSC_VER)
+    InterlockedExchange((LONG *)lock, 0);
+#else
+#error "Unrecognized compiler for atomic intrinsics!"
+#endif
+}
+
 } // namespace bhc
@@ -28,17 +28,25 @@ namespace bhc {
  * C++ emulation of FORTRAN direct output (binary). Uses a global record length
  * which is not directly encoded in the file (usually user-encoded as the first
  * word).
+ *
+ * Writes are collected in a buffer of up to BufferSize bytes, which is written
+ * to the file in one go whenever the next write is not contiguous with it. To
+ * keep runs of records contiguous, the unwritten rest of the last record in the
+ * buffer is filled with zeros (which is what the file would contain there
+ * anyway) when the next write starts in the next record. So each record must
+ * only be written once.
  */
 class DirectOFile {
 public:
     DirectOFile(bhcInternal *internal)
         : _internal(internal), recl(0), record(777777777),
           bytesWrittenThisRecord(777777777), highestRecord(0),
-          bytesWrittenHighestRecord(0)
+          bytesWrittenHighestRecord(0), bufStart(0), pos(0)
     {}
     ~DirectOFile()
     {
         if(!ostr.is_open()) return;
+        Flush();
         // End of highest record may not have been filled up, causing the file
         // length to be too short, if only part of it was written
         if(bytesWrittenHighestRecord < recl) {
@@ -65,8 +73,8 @@ public:
             highestRecord             = r;
             bytesWrittenHighestRecord = 0;
         }
-        record = r;
-        ostr.seekp(r * recl);
+        record                 = r;
+        pos                    = r * recl;
         bytesWrittenThisRecord = 0;
     }
 
@@ -74,13 +82,14 @@ public:
     void write(const char *file, int fline, const void *data, size_t bytes)
     {
         checkAndIncrement(file, fline, bytes);
-        ostr.write((const char *)data, bytes);
+        Put(data, bytes);
     }
     void write(const char *file, int fline, const std::string &str, size_t bytes)
     {
         checkAndIncrement(file, fline, bytes);
-        ostr.write(str.data(), bhc::min(bytes, str.size()));
-        for(size_t b = str.size(); b < bytes; ++b) ostr.put(' ');
+        size_t n = bhc::min(bytes, str.size());
+        Put(str.data(), n);
+        if(n < bytes) Put(std::string(bytes - n, ' ').data(), bytes - n);
     }
 #define DOFWRITEV(d, data) d.write(__FILE__, __LINE__, data)
     template<typename T> void write(const char *file, int fline, T v)
@@ -88,7 +97,26 @@ public:
         write(file, fline, &v, sizeof(T));
     }
 
+    /**
+     * Writes nrec consecutive records starting at record r. data holds
+     * bytesPerRec bytes for each record, which must not be more than the
+     * record length.
+     */
+#define DOFWRITERECS(d, r, data, nrec, bytesPerRec) \
+    d.writerecs(__FILE__, __LINE__, r, data, nrec, bytesPerRec)
+    void writerecs(
+        const char *file, int fline, size_t r, const void *data, size_t nrec,
+        size_t bytesPerRec)
+    {
+        for(size_t i = 0; i < nrec; ++i) {
+            rec(r + i);
+            write(file, fline, (const char *)data + i * bytesPerRec, bytesPerRec);
+        }
+    }
+
 private:
+    static constexpr size_t BufferSize = 16 << 20;
+
     bhcInternal *_internal;
     std::ofstream ostr;
     size_t recl;
@@ -96,6 +124,9 @@ private:
     size_t bytesWrittenThisRecord;
     size_t highestRecord;
     size_t bytesWrittenHighestRecord;
+    std::vector<char> buf;
+    size_t bufStart; // file offset of buf[0]
+    size_t pos;      // file offset of the next write
 
     void checkAndIncrement(const char *file, int fline, size_t bytes)
     {
@@ -112,6 +143,30 @@ private:
             bytesWrittenHighestRecord = bytesWrittenThisRecord;
         }
     }
+
+    void Put(const char *data, size_t bytes)
+    {
+        size_t bufEnd = bufStart + buf.size();
+        // End of the record containing the last byte in the buffer
+        size_t fillEnd = buf.empty() ? bufEnd : ((bufEnd - 1) / recl + 1) * recl;
+        if(pos < bufStart || pos > fillEnd || pos + bytes - bufStart > BufferSize) {
+            Flush();
+            bufStart = pos;
+        }
+        size_t off = pos - bufStart;
+        if(off + bytes > buf.size()) buf.resize(off + bytes, '\0');
+        memcpy(&buf[off], data, bytes);
+        pos += bytes;
+    }
+    void Put(const void *data, size_t bytes) { Put((const char *)data, bytes); }
+
+    void Flush()
+    {
+        if(buf.empty()) return;
+        ostr.seekp(bufStart);
+        ostr.write(buf.data(), buf.size());
+        buf.clear();
+    }
 };
 
 class DirectIFile {
@@ -143,6 +198,11 @@ public:
         }
     }
 
+    /// Record length in bytes.
+    size_t reclen() const { return recl; }
+    /// File length in bytes.
+    size_t length() const { return fileLen; }
+
 #define DIFREC(d, r) d.rec(__FILE__, __LINE__, r)
     void rec(const char *file, int fline, size_t r)
     {
@@ -176,6 +236,39 @@ public:
         return ret;
     }
 
+    /**
+     * Reads nrec consecutive records starting at record r, in one read. The
+     * first bytesPerRec bytes of each record are stored to data.
+     */
+#define DIFREADRECS(d, r, data, nrec, bytesPerRec) \
+    d.readrecs(__FILE__, __LINE__, r, data, nrec, bytesPerRec)
+    void readrecs(
+        const char *file, int fline, size_t r, void *data, size_t nrec,
+        size_t bytesPerRec)
+    {
+        if(nrec == 0) return;
+        if(bytesPerRec > recl || (r + nrec) * recl > fileLen) {
+            ExternalError(
+                _internal,
+                "%s:%d: DirectIFile records %" PRIuMAX "-%" PRIuMAX " of %" PRIuMAX
+                " bytes out of bounds, record length is %" PRIuMAX
+                ", file length is %" PRIuMAX,
+                file, fline, r, r + nrec - 1, bytesPerRec, recl, fileLen);
+        }
+        istr.seekg(r * recl);
+        if(bytesPerRec == recl) {
+            istr.read((char *)data, nrec * recl);
+        } else {
+            std::vector<char> buf(nrec * recl);
+            istr.read(buf.data(), buf.size());
+            for(size_t i = 0; i < nrec; ++i) {
+                memcpy((char *)data + i * bytesPerRec, &buf[i * recl], bytesPerRec);
+            }
+        }
+        record              = r + nrec - 1;
+        bytesReadThisRecord = recl;
+    }
+
 #define DIFREADV(d, data) d.read(__FILE__, __LINE__, data)
     template<typename T> void read(const char *file, int fline, T &v)
     {
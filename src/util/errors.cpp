@@ -110,12 +110,10 @@ static const char *const warningDescriptions[BHC_WARN_MAX] = {
     "consistent way, edge case issues may result",
 };
 
-void CheckReportErrors(bhcInternal *internal, const ErrState *errState)
+static void ReportErrors(
+    bhcInternal *internal, uint32_t error, uint32_t warning, uint32_t errCount,
+    uint32_t warnCount)
 {
-    uint32_t error     = errState->error.load(STD::memory_order_acquire);
-    uint32_t warning   = errState->warning.load(STD::memory_order_acquire);
-    uint32_t errCount  = errState->errCount.load(STD::memory_order_acquire);
-    uint32_t warnCount = errState->warnCount.load(STD::memory_order_acquire);
     if((error != 0) != (errCount != 0) || (warning != 0) != (warnCount != 0)) {
         ExternalError(
             internal, "Internal error with error counts in error tracking system");
@@ -153,4 +151,22 @@ void CheckReportErrors(bhcInternal *internal, const ErrState *errState)
     }
 }
 
+#ifdef BHC_BUILD_CUDA
+void CheckReportErrors(bhcInternal *internal, const ErrState *errState)
+{
+    ReportErrors(
+        internal, errState->error.load(STD::memory_order_acquire),
+        errState->warning.load(STD::memory_order_acquire),
+        errState->errCount.load(STD::memory_order_acquire),
+        errState->warnCount.load(STD::memory_order_acquire));
+}
+#endif
+
+void CheckReportErrors(bhcInternal *internal, const ErrShards &errShards)
+{
+    uint32_t error, warning, errCount, warnCount;
+    errShards.Merge(error, warning, errCount, warnCount);
+    ReportErrors(internal, error, warning, errCount, warnCount);
+}
+
 } // namespace bhc
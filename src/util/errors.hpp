@@ -26,15 +26,35 @@ namespace bhc {
 
 struct bhcInternal;
 
+#ifdef BHC_BUILD_CUDA
+
+/// All GPU threads share a single ErrState.
 struct ErrState {
     STD::atomic<uint32_t> error, warning, errCount, warnCount;
 };
 
+#else
+
+/**
+ * On the CPU, each worker has its own ErrState (see ErrShards), so that
+ * recording a warning, which may happen on every reflection of every ray, does
+ * not touch any cache line shared with other cores. The only shared state is
+ * the abort flag, which the first error sets so that all workers stop.
+ */
+struct ErrState {
+    uint32_t error, warning, errCount, warnCount;
+    STD::atomic<bool> *abort;
+};
+
+#endif
+
 [[noreturn]] extern void ExternalError(bhcInternal *internal, const char *format, ...);
 extern void ExternalWarning(bhcInternal *internal, const char *format, ...);
 #define EXTERR(...) ExternalError(GetInternal(params), __VA_ARGS__)
 #define EXTWARN(...) ExternalWarning(GetInternal(params), __VA_ARGS__)
 
+#ifdef BHC_BUILD_CUDA
+
 inline HOST_DEVICE void RunError(ErrState *errState, uint32_t code)
 {
     errState->errCount.fetch_add(1u, STD::memory_order_relaxed);
@@ -56,7 +76,101 @@ inline HOST_DEVICE void ResetErrState(ErrState *errState)
     errState->errCount  = 0u;
     errState->warnCount = 0u;
 }
+
+#else
+
+inline void RunError(ErrState *errState, uint32_t code)
+{
+    ++errState->errCount;
+    errState->error |= 1u << code;
+    errState->abort->store(true, STD::memory_order_relaxed);
+}
+inline void RunWarning(ErrState *errState, uint32_t code)
+{
+    ++errState->warnCount;
+    errState->warning |= 1u << code;
+}
+/**
+ * Whether any worker has raised an error. Relaxed: the errors themselves are
+ * only read by CheckReportErrors(), after the workers have been joined.
+ */
+inline bool HasErrored(ErrState *errState)
+{
+    return errState->abort->load(STD::memory_order_relaxed);
+}
+inline void ResetErrState(ErrState *errState, STD::atomic<bool> *abort)
+{
+    errState->error     = 0u;
+    errState->warning   = 0u;
+    errState->errCount  = 0u;
+    errState->warnCount = 0u;
+    errState->abort     = abort;
+}
+
+#endif
+
+/**
+ * The ErrStates of the workers of one run. In bellhopcuda, all workers get the
+ * same ErrState.
+ */
+class ErrShards {
+public:
+    explicit ErrShards(int32_t numWorkers)
+#ifdef BHC_BUILD_CUDA
+        : shards(1)
+    {
+        ResetErrState(&shards[0].errState);
+    }
+#else
+        : shards(numWorkers), abort(false)
+    {
+        for(auto &s : shards) ResetErrState(&s.errState, &abort);
+    }
+#endif
+    ErrShards(const ErrShards &)            = delete;
+    ErrShards &operator=(const ErrShards &) = delete;
+
+    inline ErrState *Get(int32_t worker)
+    {
+#ifdef BHC_BUILD_CUDA
+        (void)worker;
+        return &shards[0].errState;
+#else
+        return &shards[worker].errState;
+#endif
+    }
+
+    /// Whether any worker has raised an error.
+    inline bool HasErrored() { return bhc::HasErrored(Get(0)); }
+
+    /// Combined errors and warnings of all workers, in the first argument.
+    void Merge(
+        uint32_t &error, uint32_t &warning, uint32_t &errCount,
+        uint32_t &warnCount) const
+    {
+        error = warning = errCount = warnCount = 0u;
+        for(const auto &s : shards) {
+            error |= s.errState.error;
+            warning |= s.errState.warning;
+            errCount += s.errState.errCount;
+            warnCount += s.errState.warnCount;
+        }
+    }
+
+private:
+    struct alignas(64) Shard {
+        ErrState errState;
+    };
+    std::vector<Shard> shards;
+#ifndef BHC_BUILD_CUDA
+    STD::atomic<bool> abort;
+#endif
+};
+
+#ifdef BHC_BUILD_CUDA
 extern void CheckReportErrors(bhcInternal *internal, const ErrState *errState);
+#endif
+extern void CheckReportErrors(bhcInternal *internal, const ErrShards &errShards);
 
 #define BHC_ERR_TEMPLATE 0
 #define BHC_ERR_JOBNUM 1
@@ -414,18 +414,43 @@ class LDOFile {
 public:
     enum class Style : uint8_t { FORTRAN_OUTPUT, WRITTEN_BY_HAND, MATLAB_OUTPUT };
 
-    LDOFile() : iwidth(12), fwidth(15), dwidth(24), envStyle(Style::FORTRAN_OUTPUT) {}
+    LDOFile()
+        : ostr(nullptr), iwidth(12), fwidth(15), dwidth(24),
+          envStyle(Style::FORTRAN_OUTPUT)
+    {}
     ~LDOFile()
     {
-        if(ostr.is_open()) ostr.close();
+        if(filebuf.is_open()) filebuf.close();
     }
 
     void open(const std::string &path)
     {
-        ostr.open(path);
+        ostr.rdbuf(&filebuf);
+        if(filebuf.open(path, std::ios::out) == nullptr) ostr.setstate(std::ios::failbit);
+        ostr << std::setfill(' ');
+    }
+    /**
+     * Write to a memory buffer instead of a file, e.g. to format part of a
+     * file on a worker thread. The formatting does not depend on what was
+     * written before, so the buffer can later be written to the real file with
+     * writeraw() and the result is the same as writing there directly.
+     */
+    void openmem()
+    {
+        ostr.rdbuf(&membuf);
         ostr << std::setfill(' ');
     }
-    bool good() { return ostr.good() && ostr.is_open(); }
+    bool good() { return ostr.good() && (filebuf.is_open() || ostr.rdbuf() == &membuf); }
+
+    /// Returns and clears the contents of the memory buffer, see openmem().
+    std::string takemem()
+    {
+        std::string s = membuf.str();
+        membuf.str(std::string());
+        return s;
+    }
+    /// Writes already formatted data, e.g. from takemem().
+    void writeraw(const std::string &s) { ostr.write(s.data(), s.size()); }
 
     LDOFile &operator<<(const char &c)
     {
@@ -511,7 +536,9 @@ public:
     void write(const char *s) { ostr << s; }
 
 private:
-    std::ofstream ostr;
+    std::filebuf filebuf;
+    std::stringbuf membuf;
+    std::ostream ostr;
     int32_t iwidth, fwidth, dwidth;
     Style envStyle;
 
@@ -0,0 +1,126 @@
+/*
+bellhopcxx / bellhopcuda - C++/CUDA port of BELLHOP(3D) underwater acoustics simulator
+Copyright (C) 2021-2023 The Regents of the University of California
+Marine Physical Lab at Scripps Oceanography, c/o Jules Jaffe, jjaffe@ucsd.edu
+Based on BELLHOP / BELLHOP3D, which is Copyright (C) 1983-2022 Michael B. Porter
+
+This program is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#ifndef _BHC_INCLUDING_COMPONENTS_
+#error "Must be included from common_setup.hpp!"
+#endif
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace bhc {
+
+/**
+ * Read-only memory mapping of a whole file. Nothing is read when the file is
+ * opened; the OS pages in the parts of the file which are actually accessed.
+ */
+class MappedIFile {
+public:
+    MappedIFile(bhcInternal *internal)
+        : _internal(internal), ptr(nullptr), len(0)
+#ifdef _WIN32
+          ,
+          hFile(INVALID_HANDLE_VALUE), hMapping(nullptr)
+#else
+          ,
+          fd(-1)
+#endif
+    {}
+    ~MappedIFile() { close(); }
+    MappedIFile(const MappedIFile &)            = delete;
+    MappedIFile &operator=(const MappedIFile &) = delete;
+
+    void open(const std::string &path)
+    {
+        close();
+#ifdef _WIN32
+        hFile = CreateFileA(
+            path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL, nullptr);
+        LARGE_INTEGER size;
+        if(hFile == INVALID_HANDLE_VALUE || !GetFileSizeEx(hFile, &size)) {
+            ExternalError(_internal, "Failed to open MappedIFile %s", path.c_str());
+        }
+        len = (size_t)size.QuadPart;
+        if(len == 0) return;
+        hMapping = CreateFileMappingA(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if(hMapping != nullptr) {
+            ptr = (const char *)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+        }
+#else
+        fd = ::open(path.c_str(), O_RDONLY);
+        struct stat st;
+        if(fd < 0 || fstat(fd, &st) != 0) {
+            ExternalError(_internal, "Failed to open MappedIFile %s", path.c_str());
+        }
+        len = (size_t)st.st_size;
+        if(len == 0) return;
+        void *p = mmap(nullptr, len, PROT_READ, MAP_SHARED, fd, 0);
+        if(p != MAP_FAILED) ptr = (const char *)p;
+#endif
+        if(ptr == nullptr) {
+            ExternalError(
+                _internal, "Failed to map %s (%" PRIuMAX " bytes) to memory",
+                path.c_str(), len);
+        }
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        if(ptr != nullptr) UnmapViewOfFile(ptr);
+        if(hMapping != nullptr) CloseHandle(hMapping);
+        if(hFile != INVALID_HANDLE_VALUE) CloseHandle(hFile);
+        hFile    = INVALID_HANDLE_VALUE;
+        hMapping = nullptr;
+#else
+        if(ptr != nullptr) munmap((void *)ptr, len);
+        if(fd >= 0) ::close(fd);
+        fd = -1;
+#endif
+        ptr = nullptr;
+        len = 0;
+    }
+
+    const char *data() const { return ptr; }
+    size_t length() const { return len; }
+
+private:
+    bhcInternal *_internal;
+    const char *ptr;
+    size_t len;
+#ifdef _WIN32
+    HANDLE hFile;
+    HANDLE hMapping;
+#else
+    int fd;
+#endif
+};
+
+} // namespace bhc
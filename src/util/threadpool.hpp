@@ -0,0 +1,315 @@
+/*
+bellhopcxx / bellhopcuda - C++/CUDA port of BELLHOP(3D) underwater acoustics simulator
+Copyright (C) 2021-2023 The Regents of the University of California
+Marine Physical Lab at Scripps Oceanography, c/o Jules Jaffe, jjaffe@ucsd.edu
+Based on BELLHOP / BELLHOP3D, which is Copyright (C) 1983-2022 Michael B. Porter
+
+This program is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#ifndef _BHC_INCLUDING_COMPONENTS_
+#error "Must be included from common.hpp!"
+#endif
+
+namespace bhc {
+
+/**
+ * Worker threads shared by many instances, for run_batch(). RunAll() calls
+ * main(thread) on each of the numThreads threads, thread 0 being the calling
+ * thread; main() runs instances one after another. The ThreadPools of these
+ * instances are attached to this pool, so their Run() calls come here instead:
+ * Run(n, func) queues func(worker), worker = 0 ... n-1, as separate tasks, and
+ * executes queued tasks of any instance until its own tasks are done. Threads
+ * whose main() has returned keep executing tasks until all have returned. So
+ * the rays of different instances are interleaved on the same threads, and
+ * there are never more than numThreads threads busy.
+ *
+ * The tasks of one Run() must not wait for each other (no mode does).
+ */
+class SharedThreadPool {
+public:
+    SharedThreadPool(int32_t numThreads_)
+        : numThreads(numThreads_), generation(0), mainsRunning(0), quit(false),
+          mainFunc(nullptr)
+    {
+        for(int32_t i = 1; i < numThreads; ++i) {
+            threads.push_back(std::thread(&SharedThreadPool::ThreadLoop, this, i));
+        }
+    }
+    ~SharedThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        cv.notify_all();
+        for(auto &t : threads) t.join();
+    }
+    SharedThreadPool(const SharedThreadPool &)            = delete;
+    SharedThreadPool &operator=(const SharedThreadPool &) = delete;
+
+    inline int32_t NumThreads() const { return numThreads; }
+
+    /**
+     * Run main(thread) on every thread, thread = 0 ... numThreads-1, and wait
+     * until all of them have returned. If any throws, the first exception is
+     * rethrown here.
+     */
+    void RunAll(const std::function<void(int32_t)> &main)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            mainFunc      = &main;
+            mainsRunning  = numThreads;
+            mainException = nullptr;
+            ++generation;
+        }
+        cv.notify_all();
+        RunMain(0);
+        std::lock_guard<std::mutex> lock(mutex);
+        mainFunc = nullptr;
+        if(mainException) std::rethrow_exception(mainException);
+    }
+
+    /**
+     * Called from within main(): queue func(worker) for worker = 0 ... n-1,
+     * and execute queued tasks until all of these have finished. If any
+     * throws, the first exception is rethrown here.
+     */
+    void Run(int32_t n, const std::function<void(int32_t)> &func)
+    {
+        Group group;
+        group.remaining = n;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for(int32_t w = 0; w < n; ++w) tasks.push_back(Task{&func, w, &group});
+        }
+        cv.notify_all();
+        HelpUntil([&] { return group.remaining == 0; });
+        if(group.exception) std::rethrow_exception(group.exception);
+    }
+
+private:
+    struct Group {
+        int32_t remaining;
+        std::exception_ptr exception;
+    };
+    struct Task {
+        const std::function<void(int32_t)> *func;
+        int32_t worker;
+        Group *group;
+    };
+
+    void ThreadLoop(int32_t thread)
+    {
+        uint64_t lastGeneration = 0;
+        while(true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [&] { return quit || generation != lastGeneration; });
+                if(quit) return;
+                lastGeneration = generation;
+            }
+            RunMain(thread);
+        }
+    }
+
+    void RunMain(int32_t thread)
+    {
+        try {
+            (*mainFunc)(thread);
+        } catch(...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(!mainException) mainException = std::current_exception();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(--mainsRunning == 0) cv.notify_all();
+        }
+        // Every task belongs to a Run() in some main(), so once all main()s have
+        // returned, there are no tasks left.
+        HelpUntil([this] { return mainsRunning == 0; });
+    }
+
+    /// done is evaluated with mutex held.
+    template<typename F> void HelpUntil(const F &done)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while(!done()) {
+            if(tasks.empty()) {
+                cv.wait(lock);
+                continue;
+            }
+            Task t = tasks.front();
+            tasks.pop_front();
+            lock.unlock();
+            std::exception_ptr e;
+            try {
+                (*t.func)(t.worker);
+            } catch(...) {
+                e = std::current_exception();
+            }
+            lock.lock();
+            if(e && !t.group->exception) t.group->exception = e;
+            if(--t.group->remaining == 0) cv.notify_all();
+        }
+    }
+
+    int32_t numThreads;
+    std::vector<std::thread> threads;
+    std::mutex mutex; // protects everything below
+    std::condition_variable cv;
+    uint64_t generation;
+    int32_t mainsRunning;
+    bool quit;
+    const std::function<void(int32_t)> *mainFunc;
+    std::exception_ptr mainException;
+    std::deque<Task> tasks;
+};
+
+/**
+ * Persistent set of worker threads, started on the first run and parked on a
+ * condition variable between runs. Run() hands the same function to every
+ * worker (with its worker index) and blocks until all of them have returned,
+ * i.e. it behaves exactly like spawning and joining numThreads std::threads,
+ * without paying for thread creation on every call to run().
+ *
+ * If firstCore >= 0, worker i is pinned to logical core firstCore + i.
+ *
+ * While attached to a SharedThreadPool (run_batch()), Run() instead queues the
+ * numThreads workers as tasks there, and this pool's own threads are not used
+ * (nor created, if the instance is only ever run in batches).
+ */
+class ThreadPool {
+public:
+    ThreadPool(int32_t numThreads_, int32_t firstCore_ = -1)
+        : numThreads(numThreads_), firstCore(firstCore_), generation(0), running(0),
+          quit(false), task(nullptr), shared(nullptr)
+    {}
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        cvStart.notify_all();
+        for(auto &t : threads) t.join();
+    }
+    ThreadPool(const ThreadPool &)            = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    inline int32_t NumThreads() const { return numThreads; }
+
+    /// Attach to a SharedThreadPool, or detach with nullptr.
+    inline void Attach(SharedThreadPool *shared_) { shared = shared_; }
+
+    /**
+     * Run func(worker) on every worker thread, worker = 0 ... numThreads-1,
+     * and wait for all of them to finish. If any worker throws, the first
+     * exception is rethrown here after all workers have finished.
+     */
+    void Run(const std::function<void(int32_t)> &func)
+    {
+        if(shared != nullptr) {
+            shared->Run(numThreads, func);
+            return;
+        }
+        std::lock_guard<std::mutex> runLock(runMutex);
+        if(threads.empty()) {
+            for(int32_t i = 0; i < numThreads; ++i) {
+                threads.push_back(std::thread(&ThreadPool::WorkerLoop, this, i));
+            }
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        task      = &func;
+        running   = numThreads;
+        exception = nullptr;
+        ++generation;
+        cvStart.notify_all();
+        cvDone.wait(lock, [this] { return running == 0; });
+        task = nullptr;
+        if(exception) std::rethrow_exception(exception);
+    }
+
+    /**
+     * Zero n elements of ptr, with each worker zeroing one contiguous slice.
+     * Used for the output arrays instead of memset on the calling thread, so
+     * that on NUMA systems the pages are first touched (and therefore placed)
+     * by the workers which will later write them, rather than all ending up on
+     * the main thread's node.
+     */
+    template<typename T> void FirstTouch(T *ptr, size_t n)
+    {
+        ForSlices(n, [&](size_t begin, size_t end) {
+            memset((void *)(ptr + begin), 0, (end - begin) * sizeof(T));
+        });
+    }
+
+    /**
+     * Split [0, n) into one contiguous slice per worker, and run
+     * func(begin, end) for each slice in parallel. Used for loops whose
+     * iterations all cost about the same, e.g. rows of receivers.
+     */
+    template<typename F> void ForSlices(size_t n, const F &func)
+    {
+        Run([&](int32_t worker) {
+            size_t begin = n * (size_t)worker / (size_t)numThreads;
+            size_t end   = n * (size_t)(worker + 1) / (size_t)numThreads;
+            if(begin < end) func(begin, end);
+        });
+    }
+
+private:
+    void WorkerLoop(int32_t worker)
+    {
+        SetupThread(firstCore >= 0 ? firstCore + worker : -1);
+        uint64_t lastGeneration = 0;
+        while(true) {
+            const std::function<void(int32_t)> *func;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cvStart.wait(
+                    lock, [&] { return quit || generation != lastGeneration; });
+                if(quit) return;
+                lastGeneration = generation;
+                func           = task;
+            }
+            try {
+                (*func)(worker);
+            } catch(...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if(!exception) exception = std::current_exception();
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if(--running == 0) cvDone.notify_all();
+            }
+        }
+    }
+
+    int32_t numThreads;
+    int32_t firstCore;
+    std::vector<std::thread> threads;
+    std::mutex runMutex; // serializes concurrent Run() calls
+    std::mutex mutex;    // protects everything below
+    std::condition_variable cvStart, cvDone;
+    uint64_t generation;
+    int32_t running;
+    bool quit;
+    const std::function<void(int32_t)> *task;
+    std::exception_ptr exception;
+    SharedThreadPool *shared;
+};
+
+} // namespace bhc
@@ -23,12 +23,27 @@ this program. If not, see <https://www.gnu.org/licenses/>.
 #else
 // sched_setscheduler():
 #include <sched.h>
+#ifdef __linux__
+#include <pthread.h>
+#endif
 #endif
 
 namespace bhc {
 
-void SetupThread()
+void SetupThread(int32_t core)
 {
+    if(core >= 0) {
+#ifdef __linux__
+        int32_t ncores = (int32_t)std::thread::hardware_concurrency();
+        if(ncores > 0) core %= ncores;
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(core, &cpuset);
+        if(pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset) != 0) {
+            std::cout << "Could not pin thread to core " << core << "\n";
+        }
+#endif
+    }
 #ifdef BHC_USE_HIGH_PRIORITY_THREADS
 #if defined(_WIN32) || defined(_WIN64)
     // std::cout << "Warning, not changing thread priority because on Windows\n";
@@ -26,7 +26,11 @@ namespace bhc {
 
 // #define BHC_USE_HIGH_PRIORITY_THREADS 1
 
-void SetupThread();
+/**
+ * Called once at the start of each worker thread. If core >= 0, pins the
+ * thread to that logical core (modulo the number of logical cores).
+ */
+void SetupThread(int32_t core = -1);
 
 inline int32_t ModifyNumThreads(int32_t numThreads)
 {
@@ -31,19 +31,53 @@ namespace bhc {
  */
 class UnformattedOFile {
 public:
-    UnformattedOFile(bhcInternal *internal) : _internal(internal), recstart(-1), recl(-1)
+    UnformattedOFile(bhcInternal *internal)
+        : _internal(internal), ostr(nullptr), recstart(-1), recl(-1)
     {}
     ~UnformattedOFile()
     {
-        if(ostr.is_open()) {
+        if(filebuf.is_open()) {
             FinishRecord();
-            ostr.close();
+            filebuf.close();
         }
     }
 
-    void open(const std::string &path) { ostr.open(path, std::ios::binary); }
+    void open(const std::string &path)
+    {
+        ostr.rdbuf(&filebuf);
+        if(filebuf.open(path, std::ios::out | std::ios::binary) == nullptr) {
+            ostr.setstate(std::ios::failbit);
+        }
+    }
+    /**
+     * Write to a memory buffer instead of a file, e.g. to write part of a file
+     * on a worker thread. Records are complete when taken with takemem(), so
+     * the buffer can be appended to the real file with writeraw().
+     */
+    void openmem() { ostr.rdbuf(&membuf); }
 
-    bool good() { return ostr.good() && ostr.is_open(); }
+    bool good() { return ostr.good() && (filebuf.is_open() || ostr.rdbuf() == &membuf); }
+
+    /// Finishes the current record, and returns and clears the memory buffer.
+    std::string takemem()
+    {
+        FinishRecord();
+        std::string s = membuf.str();
+        membuf.str(std::string());
+        ostr.seekp(0);
+        recstart = -1;
+        recl     = -1;
+        return s;
+    }
+    /// Finishes the current record and appends complete records, e.g. from
+    /// takemem(). rec() must be called before writing anything else.
+    void writeraw(const std::string &s)
+    {
+        FinishRecord();
+        ostr.write(s.data(), s.size());
+        recstart += (int32_t)s.size();
+        recl = -1;
+    }
 
     void rec()
     {
@@ -54,7 +88,7 @@ public:
 
     template<typename T> void write(T v)
     {
-        if(recstart < 0) {
+        if(recl < 0) {
             ExternalError(_internal, "Missing record in UnformattedOFile!");
         }
         ostr.write((const char *)&v, sizeof(T));
@@ -63,7 +97,7 @@ public:
 
     template<typename T> void write(T *arr, size_t n)
     {
-        if(recstart < 0) {
+        if(recl < 0) {
             ExternalError(_internal, "Missing record in UnformattedOFile!");
         }
         for(size_t i = 0; i < n; ++i) ostr.write((const char *)&arr[i], sizeof(T));
@@ -73,8 +107,8 @@ public:
 private:
     void FinishRecord()
     {
-        if(recstart < 0 || recl < 0) {
-            recstart = 0;
+        if(recl < 0) { // no record open
+            recstart = bhc::max(recstart, 0);
             recl     = 0;
             return;
         }
@@ -87,7 +121,9 @@ private:
     }
 
     bhcInternal *_internal;
-    std::ofstream ostr;
+    std::filebuf filebuf;
+    std::stringbuf membuf;
+    std::ostream ostr;
     int32_t recstart;
     int32_t recl;
 };